@@ -0,0 +1,120 @@
+// ArmLayout.h
+#ifndef ARM_LAYOUT_H
+#define ARM_LAYOUT_H
+
+#include <FastLED.h>
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <tuple>
+#include <utility>
+
+// Compile-time description of one physical strip on the arm.
+// OFFSET is where the strip's first pixel sits along the arm, REVERSED means
+// the strip is wired from the far end back towards the base.
+template <uint8_t PIN, uint16_t LENGTH, EOrder ORDER = RGB, uint16_t OFFSET = 0, bool REVERSED = false>
+struct StripLayout {
+  static constexpr uint8_t pin = PIN;
+  static constexpr uint16_t length = LENGTH;
+  static constexpr EOrder order = ORDER;
+  static constexpr uint16_t offset = OFFSET;
+  static constexpr bool reversed = REVERSED;
+  static constexpr uint16_t end = OFFSET + LENGTH;  // first arm position past the strip
+
+  // Physical index of an arm position on this strip, -1 when it is not covered
+  static constexpr int16_t physical(int pos) {
+    return (pos < OFFSET || pos >= end) ? -1
+         : REVERSED ? (int16_t)(end - 1 - pos)
+         : (int16_t)(pos - OFFSET);
+  }
+
+  // Fill arm positions [start, start + count) that fall on this strip.
+  // The span is clipped once, so there is no per-pixel bounds check.
+  static void fill(CRGB* leds, int start, int count, const CRGB& color) {
+    int lo = start - OFFSET;
+    int hi = lo + count;
+    lo = lo < 0 ? 0 : (lo > LENGTH ? LENGTH : lo);
+    hi = hi < lo ? lo : (hi > LENGTH ? LENGTH : hi);
+    if (REVERSED) fill_solid(leds + (LENGTH - hi), hi - lo, color);
+    else fill_solid(leds + lo, hi - lo, color);
+  }
+};
+
+// A set of strips driven together as one logical arm. Effects address "arm
+// position" 0..length-1; the layout maps that onto every strip covering it.
+template <typename... Strips>
+class ArmLayout {
+public:
+  static constexpr size_t stripCount = sizeof...(Strips);
+  static constexpr uint16_t length = std::max({Strips::end...});
+
+  template <size_t I>
+  using Strip = typename std::tuple_element<I, std::tuple<Strips...>>::type;
+
+  // LED buffers in the same order as Strips
+  typedef CRGB* const Buffers[stripCount];
+
+  // Logical-to-physical index map, -1 where a strip has no pixel
+  struct PixelMap {
+    int16_t index[length][stripCount];
+  };
+
+  static constexpr PixelMap buildMap() {
+    PixelMap m{};
+    for (int pos = 0; pos < length; ++pos) {
+      int16_t row[stripCount] = {Strips::physical(pos)...};
+      for (size_t s = 0; s < stripCount; ++s) m.index[pos][s] = row[s];
+    }
+    return m;
+  }
+
+  static constexpr PixelMap map = buildMap();
+
+  // Register every strip with FastLED, e.g. Arm::addLeds<WS2811>(armStrips)
+  template <template <uint8_t, EOrder> class CHIPSET>
+  static void addLeds(Buffers& leds) {
+    addLedsImpl<CHIPSET>(leds, std::index_sequence_for<Strips...>());
+  }
+
+  // Fill arm positions [start, start + count) on all strips; out-of-range
+  // parts of the span are clipped per strip
+  static void fill(Buffers& leds, int start, int count, const CRGB& color) {
+    fillImpl(leds, start, count, color, std::index_sequence_for<Strips...>());
+  }
+
+  static void clear(Buffers& leds) {
+    fill(leds, 0, length, CRGB::Black);
+  }
+
+  // nscale8_video() on every strip
+  static void scale(Buffers& leds, uint8_t scale) {
+    scaleImpl(leds, scale, std::index_sequence_for<Strips...>());
+  }
+
+  // Set one arm position through the precomputed map
+  static void set(Buffers& leds, uint16_t pos, const CRGB& color) {
+    if (pos >= length) return;
+    for (size_t s = 0; s < stripCount; ++s) {
+      int16_t i = map.index[pos][s];
+      if (i >= 0) leds[s][i] = color;
+    }
+  }
+
+private:
+  template <template <uint8_t, EOrder> class CHIPSET, size_t... I>
+  static void addLedsImpl(Buffers& leds, std::index_sequence<I...>) {
+    (FastLED.addLeds<CHIPSET, Strip<I>::pin, Strip<I>::order>(leds[I], Strip<I>::length), ...);
+  }
+
+  template <size_t... I>
+  static void fillImpl(Buffers& leds, int start, int count, const CRGB& color, std::index_sequence<I...>) {
+    (Strip<I>::fill(leds[I], start, count, color), ...);
+  }
+
+  template <size_t... I>
+  static void scaleImpl(Buffers& leds, uint8_t scale, std::index_sequence<I...>) {
+    (nscale8_video(leds[I], Strip<I>::length, scale), ...);
+  }
+};
+
+#endif // ARM_LAYOUT_H
@@ -0,0 +1,38 @@
+#include "ArmState.h"
+
+ArmStateStore ArmState;
+
+bool ArmStateStore::begin(ArmSettings& out) {
+  opened = prefs.begin(ARM_STATE_NAMESPACE, false);
+  if (!opened) return false;
+
+  ArmSettings loaded;
+  size_t len = prefs.getBytes(ARM_STATE_KEY, &loaded, sizeof(loaded));
+  if (len != sizeof(loaded) || loaded.version != ARM_STATE_VERSION) return false;
+
+  stored = loaded;
+  pending = loaded;
+  hasStored = true;
+  out = loaded;
+  return true;
+}
+
+void ArmStateStore::update() {
+  if (!writeDue) return;
+  writeDue = false;
+  if (!differs()) return;
+
+  uint32_t now = millis();
+  if (writeCount > 0 && now - lastWriteMs < ARM_STATE_MIN_INTERVAL_MS) {
+    // Too soon after the previous write: check again after another debounce
+    Timers.restart(debounceTimer);
+    return;
+  }
+
+  if (prefs.putBytes(ARM_STATE_KEY, &pending, sizeof(pending)) == sizeof(pending)) {
+    stored = pending;
+    hasStored = true;
+    lastWriteMs = now;
+    writeCount++;
+  }
+}
@@ -0,0 +1,98 @@
+// ArmState.h
+#ifndef ARM_STATE_H
+#define ARM_STATE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "TimerWheel.h"
+
+// Quiet time after the last change before it is written to NVS, so a burst
+// of UPDATE_STAR commands ends up as a single write
+#ifndef ARM_STATE_DEBOUNCE_MS
+#define ARM_STATE_DEBOUNCE_MS 2000
+#endif
+
+// Minimum time between two NVS writes (flash wear)
+#ifndef ARM_STATE_MIN_INTERVAL_MS
+#define ARM_STATE_MIN_INTERVAL_MS 10000
+#endif
+
+#define ARM_STATE_NAMESPACE "arm"
+#define ARM_STATE_KEY "state"
+#define ARM_STATE_VERSION 1
+
+// Everything the arm needs to be usable again after a power cycle.
+// Field order keeps the struct free of padding, so it can be compared with memcmp.
+struct ArmSettings {
+  uint8_t version;
+  uint8_t micBrightness;
+  uint8_t sendBrightness;
+  uint8_t sendSpeed;
+  uint8_t sendR, sendG, sendB;
+  bool starIsMade;
+  int16_t sendSize;
+};
+
+class ArmStateStore {
+private:
+  Preferences prefs;
+  ArmSettings stored;   // what NVS currently holds
+  ArmSettings pending;  // latest state handed to save()
+  bool hasStored;
+  bool opened;
+  bool writeDue;
+  uint32_t lastWriteMs;
+  uint32_t writeCount;
+  TimerId debounceTimer;
+
+  static void onDebounce(void* ctx) {
+    // Only flag it: NVS writes take milliseconds and Timers may fire mid-animation
+    static_cast<ArmStateStore*>(ctx)->writeDue = true;
+  }
+
+  bool differs() const {
+    return !hasStored || memcmp(&stored, &pending, sizeof(ArmSettings)) != 0;
+  }
+
+public:
+  ArmStateStore()
+    : hasStored(false), opened(false), writeDue(false), lastWriteMs(0),
+      writeCount(0), debounceTimer(TIMER_INVALID) {
+    memset(&stored, 0, sizeof(stored));
+    memset(&pending, 0, sizeof(pending));
+  }
+
+  // Open NVS and read the last saved state. Returns true when a valid state
+  // was restored into out; out is left untouched otherwise.
+  bool begin(ArmSettings& out);
+
+  // Queue a state for writing. Identical states are ignored; changes are
+  // written once they have been stable for ARM_STATE_DEBOUNCE_MS.
+  void save(const ArmSettings& settings) {
+    if (!opened) return;
+    pending = settings;
+    pending.version = ARM_STATE_VERSION;
+    if (!differs()) {
+      Timers.stop(debounceTimer);
+      writeDue = false;
+      return;
+    }
+    if (debounceTimer == TIMER_INVALID) {
+      debounceTimer = Timers.once(ARM_STATE_DEBOUNCE_MS, onDebounce, this);
+    } else {
+      Timers.restart(debounceTimer);
+    }
+  }
+
+  // Perform a due write; call from loop()
+  void update();
+
+  // Number of NVS writes since boot
+  uint32_t writes() const {
+    return writeCount;
+  }
+};
+
+extern ArmStateStore ArmState;
+
+#endif // ARM_STATE_H
@@ -0,0 +1,221 @@
+#include "FrameStream.h"
+
+FrameStreamDecoder FrameStream;
+
+#define FPS_WINDOW_MS 1000
+
+static int base64Value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+FrameStreamDecoder::FrameStreamDecoder() : stripCount(0) {
+  reset(false);
+  inFrame = false;
+  haveSeq = false;
+  needKey = true;
+  currentSeq = 0;
+  frameCount = droppedCount = errorCount = 0;
+  rawBytes = encodedBytes = 0;
+  presentHead = 0;
+}
+
+bool FrameStreamDecoder::attach(const char* name, CRGB* front, CRGB* back, uint16_t length) {
+  if (stripCount >= FRAMESTREAM_MAX_STRIPS) return false;
+  Target& t = strips[stripCount++];
+  t.name = name;
+  t.front = front;
+  t.back = back;
+  t.length = length;
+  memcpy(back, front, length * sizeof(CRGB));
+  t.dirtyLo = length;
+  t.dirtyHi = -1;
+  return true;
+}
+
+FrameStreamDecoder::Target* FrameStreamDecoder::find(const String& name) {
+  for (int i = 0; i < stripCount; ++i) {
+    if (strips[i].name == name) return &strips[i];
+  }
+  return nullptr;
+}
+
+void FrameStreamDecoder::reset(bool clearBuffers) {
+  for (int i = 0; i < FRAMESTREAM_PALETTE_SIZE; ++i) palette[i] = CRGB::Black;
+  if (clearBuffers) {
+    for (int i = 0; i < stripCount; ++i) {
+      fill_solid(strips[i].back, strips[i].length, CRGB::Black);
+      strips[i].dirtyLo = 0;
+      strips[i].dirtyHi = strips[i].length - 1;
+    }
+  }
+}
+
+// Unpadded base64 into payload; returns the decoded length or -1
+int FrameStreamDecoder::decodeBase64(const String& in) {
+  int len = 0;
+  uint32_t acc = 0;
+  int bits = 0;
+  for (unsigned int i = 0; i < in.length(); ++i) {
+    int v = base64Value(in.charAt(i));
+    if (v < 0) return -1;
+    acc = (acc << 6) | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      if (len >= FRAMESTREAM_MAX_PAYLOAD) return -1;
+      payload[len++] = (acc >> bits) & 0xFF;
+    }
+  }
+  return len;
+}
+
+bool FrameStreamDecoder::apply(Target& t, int len, String& error) {
+  int pos = 0;
+  int i = 0;
+  int lo = t.length;
+  int hi = -1;
+
+  while (i < len) {
+    uint8_t op = payload[i++];
+    int arg = op & 0x3F;
+    int count = arg + 1;
+
+    switch (op >> 6) {
+      case FRAMESTREAM_OP_SKIP:
+        pos += count;
+        if (pos > t.length) { error = "FRAME_OVERRUN"; return false; }
+        break;
+
+      case FRAMESTREAM_OP_RUN:
+        if (i >= len) { error = "FRAME_TRUNCATED"; return false; }
+        if (pos + count > t.length) { error = "FRAME_OVERRUN"; return false; }
+        if (payload[i] >= FRAMESTREAM_PALETTE_SIZE) { error = "BAD_PALETTE_INDEX"; return false; }
+        fill_solid(t.back + pos, count, palette[payload[i++]]);
+        if (pos < lo) lo = pos;
+        pos += count;
+        hi = pos - 1;
+        break;
+
+      case FRAMESTREAM_OP_LITERAL:
+        if (i + 3 * count > len) { error = "FRAME_TRUNCATED"; return false; }
+        if (pos + count > t.length) { error = "FRAME_OVERRUN"; return false; }
+        if (pos < lo) lo = pos;
+        for (int k = 0; k < count; ++k, i += 3) {
+          t.back[pos++] = CRGB(payload[i], payload[i + 1], payload[i + 2]);
+        }
+        hi = pos - 1;
+        break;
+
+      case FRAMESTREAM_OP_PALETTE:
+        if (i + 3 > len) { error = "FRAME_TRUNCATED"; return false; }
+        palette[arg] = CRGB(payload[i], payload[i + 1], payload[i + 2]);
+        i += 3;
+        break;
+    }
+  }
+
+  if (lo < t.dirtyLo) t.dirtyLo = lo;
+  if (hi > t.dirtyHi) t.dirtyHi = hi;
+  return true;
+}
+
+// Copy only the changed span of every strip to the LED buffers
+void FrameStreamDecoder::present() {
+  for (int i = 0; i < stripCount; ++i) {
+    Target& t = strips[i];
+    if (t.dirtyHi >= t.dirtyLo) {
+      memcpy(t.front + t.dirtyLo, t.back + t.dirtyLo, (t.dirtyHi - t.dirtyLo + 1) * sizeof(CRGB));
+    }
+    t.dirtyLo = t.length;
+    t.dirtyHi = -1;
+  }
+
+  frameCount++;
+  presentMs[presentHead] = millis();
+  presentHead = (presentHead + 1) % FRAMESTREAM_FPS_HISTORY;
+}
+
+float FrameStreamDecoder::fps() const {
+  uint32_t now = millis();
+  int stored = frameCount < FRAMESTREAM_FPS_HISTORY ? frameCount : FRAMESTREAM_FPS_HISTORY;
+  int recent = 0;
+  for (int i = 0; i < stored; ++i) {
+    if (now - presentMs[i] < FPS_WINDOW_MS) recent++;
+  }
+  if (recent == FRAMESTREAM_FPS_HISTORY) {
+    // Faster than the ring holds per window: measure over the span it covers
+    uint32_t span = now - presentMs[presentHead];
+    return span ? recent * 1000.0f / span : recent * 1000.0f;
+  }
+  return recent * 1000.0f / FPS_WINDOW_MS;
+}
+
+void FrameStreamDecoder::invalidate() {
+  needKey = true;
+  inFrame = false;
+}
+
+FrameResult FrameStreamDecoder::processCommand(const cmdlib::Command& cmd, String& error) {
+  Target* t = find(cmd.getNamed("s"));
+  if (!t) { error = "UNKNOWN_STRIP"; errorCount++; return FRAME_ERROR; }
+
+  uint16_t seq = (uint16_t)cmd.getNamed("q", "0").toInt();
+  bool key = cmd.getNamed("k", "0").toInt() == 1;
+  bool end = cmd.getNamed("end", "0").toInt() == 1;
+
+  int16_t ahead = haveSeq ? (int16_t)(seq - currentSeq) : 1;
+  bool resend = ahead == 0 && !inFrame && needKey;  // frame was rejected, sender tries again
+  if (ahead < 0 || (ahead == 0 && !inFrame && !resend)) {
+    // Retransmitted or late packet of a frame that is already done
+    error = "STALE_FRAME";
+    errorCount++;
+    return FRAME_ERROR;
+  }
+
+  if (ahead > 0 || resend) {
+    // First packet of a new frame. Only forward gaps count as dropped: the
+    // frames in between, plus the previous one if it never got its end packet.
+    int missed = ahead > 0 ? ahead - 1 + (inFrame ? 1 : 0) : 0;
+    if (missed > 0) {
+      droppedCount += missed;
+      needKey = true;
+    }
+    if (key) {
+      reset(true);
+    }
+    inFrame = true;
+    haveSeq = true;
+    currentSeq = seq;
+  }
+
+  if (needKey && !key) {
+    inFrame = false;
+    error = "NEED_KEYFRAME";
+    errorCount++;
+    return FRAME_ERROR;
+  }
+  needKey = false;
+
+  int len = decodeBase64(cmd.getNamed("d"));
+  if (len < 0) { error = "BAD_PAYLOAD"; errorCount++; needKey = true; inFrame = false; return FRAME_ERROR; }
+  if (!apply(*t, len, error)) {
+    // The back buffer is now partly updated and no longer matches the sender
+    errorCount++;
+    needKey = true;
+    inFrame = false;
+    return FRAME_ERROR;
+  }
+  rawBytes += t->length * 3;
+  encodedBytes += len;
+
+  if (!end) return FRAME_PENDING;
+
+  present();
+  inFrame = false;
+  return FRAME_READY;
+}
@@ -0,0 +1,110 @@
+// FrameStream.h
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include "CmdLib.h"
+
+#ifndef FRAMESTREAM_MAX_STRIPS
+#define FRAMESTREAM_MAX_STRIPS 4
+#endif
+
+// Largest decoded payload of one FRAME packet, in bytes
+#ifndef FRAMESTREAM_MAX_PAYLOAD
+#define FRAMESTREAM_MAX_PAYLOAD 1024
+#endif
+
+// Present times kept for fps(); bounds the rate it can measure per second
+#ifndef FRAMESTREAM_FPS_HISTORY
+#define FRAMESTREAM_FPS_HISTORY 64
+#endif
+
+#define FRAMESTREAM_PALETTE_SIZE 64
+
+// Opcodes: top two bits of each op byte, low six bits are the argument
+#define FRAMESTREAM_OP_SKIP 0     // skip n+1 pixels (unchanged)
+#define FRAMESTREAM_OP_RUN 1      // n+1 pixels of palette[next byte]
+#define FRAMESTREAM_OP_LITERAL 2  // n+1 pixels, 3 bytes RGB each
+#define FRAMESTREAM_OP_PALETTE 3  // palette[n] = next 3 bytes RGB
+
+enum FrameResult {
+  FRAME_PENDING,  // packet applied, frame not complete yet
+  FRAME_READY,    // frame complete and copied to the LED buffers: call show()
+  FRAME_ERROR     // packet rejected, error is set
+};
+
+// Decodes FRAME packets (per-strip RLE/palette deltas against the previous
+// frame) into back buffers, and copies them to the LED buffers once a frame
+// is complete so FastLED never shows a half-decoded frame.
+class FrameStreamDecoder {
+private:
+  struct Target {
+    String name;
+    CRGB* front;      // buffer registered with FastLED
+    CRGB* back;       // decode target, holds the previous frame between packets
+    uint16_t length;
+    int dirtyLo;      // range changed since the last present(), lo > hi when clean
+    int dirtyHi;
+  };
+
+  Target strips[FRAMESTREAM_MAX_STRIPS];
+  int stripCount;
+  CRGB palette[FRAMESTREAM_PALETTE_SIZE];
+  uint8_t payload[FRAMESTREAM_MAX_PAYLOAD];
+
+  bool inFrame;       // packets of currentSeq received, end not seen yet
+  bool haveSeq;       // currentSeq is valid
+  bool needKey;       // deltas are useless until the next key frame
+  uint16_t currentSeq;  // newest frame number accepted
+
+  uint32_t frameCount;
+  uint32_t droppedCount;
+  uint32_t errorCount;
+  uint32_t rawBytes;      // 3 bytes per pixel of every strip packet
+  uint32_t encodedBytes;  // decoded payload bytes actually sent
+  uint32_t presentMs[FRAMESTREAM_FPS_HISTORY];  // ring of recent present() times
+  uint8_t presentHead;                         // oldest entry once the ring is full
+
+  Target* find(const String& name);
+  int decodeBase64(const String& in);
+  bool apply(Target& t, int len, String& error);
+  void present();
+  void reset(bool clearBuffers);
+
+public:
+  FrameStreamDecoder();
+
+  // Register a strip; back must have room for length pixels
+  bool attach(const char* name, CRGB* front, CRGB* back, uint16_t length);
+
+  // Handle one REQUEST:FRAME command (see README for parameters)
+  FrameResult processCommand(const cmdlib::Command& cmd, String& error);
+
+  // Other effects drew over the LED buffers: deltas need a key frame first
+  void invalidate();
+
+  // Presented frames per second over the last second, as of now
+  float fps() const;
+
+  // Raw RGB bytes covered by the received packets divided by payload bytes
+  float compressionRatio() const {
+    return encodedBytes ? (float)rawBytes / encodedBytes : 0.0f;
+  }
+
+  uint32_t frames() const {
+    return frameCount;
+  }
+
+  uint32_t dropped() const {
+    return droppedCount;
+  }
+
+  uint32_t errors() const {
+    return errorCount;
+  }
+};
+
+extern FrameStreamDecoder FrameStream;
+
+#endif // FRAME_STREAM_H
@@ -5,28 +5,97 @@
 
 #include <Arduino.h>
 #include "CmdLib.h"
+#include "TimerWheel.h"
+
+// Number of masters tracked individually; extra senders share the grace timer
+#ifndef PINGPONG_MAX_PEERS
+#define PINGPONG_MAX_PEERS 4
+#endif
 
 // Global IDLE flag that can be checked from anywhere
 extern bool PING_IDLE;
 
 class PingPongHandler {
 private:
-  unsigned long lastPingTime;
+  struct Peer {
+    PingPongHandler* owner;
+    String name;     // first header of the PING, e.g. "MASTER"
+    TimerId timer;   // one-shot liveness timer, restarted on every PING
+    bool alive;
+  };
+
   unsigned long idleTimeoutMs;
   bool initialized;
   Stream* serialPort; // Reference to the serial port to use
 
+  Peer peers[PINGPONG_MAX_PEERS];
+  int peerCount;
+  TimerId graceTimer; // keeps the link alive for one timeout after init()
+  bool graceActive;
+
+  static void onGraceExpired(void* ctx) {
+    PingPongHandler* self = static_cast<PingPongHandler*>(ctx);
+    self->graceActive = false;
+    self->refreshIdle();
+  }
+
+  static void onPeerExpired(void* ctx) {
+    Peer* peer = static_cast<Peer*>(ctx);
+    peer->alive = false;
+    peer->owner->refreshIdle();
+  }
+
+  // Idle once the grace period is over and no peer has pinged within the timeout
+  void refreshIdle() {
+    bool anyAlive = graceActive;
+    for (int i = 0; i < peerCount && !anyAlive; ++i) anyAlive = peers[i].alive;
+    PING_IDLE = !anyAlive;
+  }
+
+  // Restart the liveness timer of the sender, adding it if it is new
+  void touchPeer(const String& name) {
+    Peer* slot = nullptr;
+    for (int i = 0; i < peerCount; ++i) {
+      if (peers[i].name == name) { slot = &peers[i]; break; }
+    }
+    if (!slot) {
+      // Reuse a peer that timed out before growing the table
+      for (int i = 0; i < peerCount; ++i) {
+        if (!peers[i].alive) { slot = &peers[i]; break; }
+      }
+      if (!slot && peerCount < PINGPONG_MAX_PEERS) {
+        slot = &peers[peerCount++];
+        slot->owner = this;
+        slot->timer = Timers.once(idleTimeoutMs, onPeerExpired, slot);
+      }
+      if (slot) slot->name = name;
+    }
+
+    if (slot && slot->timer != TIMER_INVALID) {
+      Timers.restart(slot->timer);
+      slot->alive = true;
+    } else {
+      // Table or timer pool full: fall back to one shared liveness window
+      graceActive = Timers.restart(graceTimer);
+    }
+    PING_IDLE = false;
+  }
+
 public:
   // Default constructor
-  PingPongHandler() : initialized(false), idleTimeoutMs(30000), serialPort(&Serial) {
-    lastPingTime = millis();
-  }
+  PingPongHandler()
+    : idleTimeoutMs(30000), initialized(false), serialPort(&Serial),
+      peerCount(0), graceTimer(TIMER_INVALID), graceActive(false) {}
 
   // Initialize with device ID and timeout
   void init(unsigned long timeoutMs = 30000, Stream* serial = &Serial) {
     idleTimeoutMs = timeoutMs;
     serialPort = serial;
-    lastPingTime = millis();
+    for (int i = 0; i < peerCount; ++i) Timers.cancel(peers[i].timer);
+    peerCount = 0;
+    Timers.cancel(graceTimer);
+    graceTimer = Timers.once(idleTimeoutMs, onGraceExpired, this);
+    graceActive = true;
     initialized = true;
     PING_IDLE = false;
   }
@@ -43,35 +112,49 @@ public:
     }
   }
   
-  // Process a parsed command
-  void processCommand(const cmdlib::Command& cmd) {
+  // Process a parsed command. rxUs is the micros() at which the command's
+  // first byte reached the UART (0 = now); it is only used for clock sync,
+  // see README.
+  void processCommand(const cmdlib::Command& cmd, uint32_t rxUs = 0) {
     if (!initialized) return;
     
     // Check if this is a PING request
     if (cmd.msgKind == "REQUEST" && cmd.command == "PING") {
-      lastPingTime = millis();
-      PING_IDLE = false;
+      if (rxUs == 0) rxUs = micros();
+      touchPeer(cmd.getHeader(0));
       
       cmdlib::Command response;
       // Send's back to who requested the PING
       response.addHeader(cmd.getHeader(0));
       response.msgKind = "CONFIRM";
       response.command = "PING";
+
+      // Clock sync: echo the sender's timestamp with our receive/send times.
+      // Drain earlier output first so tx is when the reply's first byte goes out
+      String t = cmd.getNamed("t");
+      if (t.length() > 0) {
+        serialPort->flush();
+        response.setNamed("t", t);
+        response.setNamed("rx", String(rxUs));
+        response.setNamed("tx", String(micros()));
+      }
       
       serialPort->println(response.toString());
     }
   }
   
-  // Update the idle status (call this regularly)
+  // Liveness now runs on the timer wheel; this only drives Timers for
+  // sketches that do not call Timers.update() themselves
   void update() {
     if (!initialized) return;
-    
-    unsigned long now = millis();
-    
-    // Check if we've exceeded the idle timeout
-    if (now - lastPingTime > idleTimeoutMs) {
-      PING_IDLE = true;
-    }
+    Timers.update();
+  }
+
+  // Number of masters that pinged within the timeout
+  int alivePeers() const {
+    int count = 0;
+    for (int i = 0; i < peerCount; ++i) if (peers[i].alive) count++;
+    return count;
   }
   
   // Get current idle status
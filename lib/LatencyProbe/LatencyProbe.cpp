@@ -0,0 +1,3 @@
+#include "LatencyProbe.h"
+
+LatencyProbe Probe;
@@ -0,0 +1,116 @@
+// LatencyProbe.h
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <Arduino.h>
+#include "CmdLib.h"
+
+// Probe mode at boot; the central unit can switch it with PROBE{enabled=0|1}
+#ifndef LATENCY_PROBE_DEFAULT
+#define LATENCY_PROBE_DEFAULT false
+#endif
+
+// Device-side timestamps (micros()) along the command-to-photon path:
+// first byte in the UART, first byte read, parse complete, handler dispatch
+// and first show() after it.
+class LatencyProbe {
+private:
+  bool enabled;
+  Stream* serialPort;
+
+  uint32_t lineArrivalUs;  // first byte of the line being received, in the UART
+  uint32_t lineReadUs;     // ... and read by the loop
+  uint32_t rxUs;           // the same two for the command being handled
+  uint32_t readUs;
+  uint32_t parseUs;
+  uint32_t dispatchUs;
+
+  bool awaitingShow;
+  String command;
+  String probeId;        // optional "pid" param echoed back to the sender
+
+  void addTimestamps(cmdlib::Command& reply) const {
+    reply.setNamed("t_rx", String(rxUs));
+    reply.setNamed("t_read", String(readUs));
+    reply.setNamed("t_parse", String(parseUs));
+    reply.setNamed("t_dispatch", String(dispatchUs));
+    if (probeId.length() > 0) reply.setNamed("pid", probeId);
+  }
+
+public:
+  LatencyProbe()
+    : enabled(LATENCY_PROBE_DEFAULT), serialPort(&Serial), lineArrivalUs(0), lineReadUs(0),
+      rxUs(0), readUs(0), parseUs(0), dispatchUs(0), awaitingShow(false) {}
+
+  void init(Stream* serial = &Serial) {
+    serialPort = serial;
+  }
+
+  void setEnabled(bool on) {
+    enabled = on;
+    awaitingShow = false;
+  }
+
+  bool isEnabled() const {
+    return enabled;
+  }
+
+  // First byte of a new line was read; arrivalUs is when it reached the UART
+  // (SessionCapture.arrivedAt()), so time spent queued behind a blocking
+  // animation shows up between t_rx and t_read
+  void markLineStart(uint32_t arrivalUs) {
+    lineArrivalUs = arrivalUs;
+    lineReadUs = micros();
+  }
+
+  // Line complete and parsed; starts a new measurement
+  void markParsed() {
+    rxUs = lineArrivalUs;
+    readUs = lineReadUs;
+    parseUs = micros();
+    dispatchUs = 0;
+    awaitingShow = false;
+    probeId = "";
+  }
+
+  // Command routed to its handler, before the handler validates parameters
+  void markDispatch(const cmdlib::Command& cmd) {
+    dispatchUs = micros();
+    command = cmd.command;
+    probeId = cmd.getNamed("pid");
+  }
+
+  // The handler will change the LEDs: report the next show() completion
+  void expectShow() {
+    awaitingShow = enabled;
+  }
+
+  // Call right after FastLED.show() returns
+  void markShown() {
+    if (!awaitingShow) return;
+    awaitingShow = false;
+
+    cmdlib::Command probe;
+    probe.addHeader("MASTER");
+    probe.msgKind = "CONFIRM";
+    probe.command = "PROBE";
+    probe.setNamed("cmd", command);
+    addTimestamps(probe);
+    probe.setNamed("t_show", String(micros()));
+    serialPort->println(probe.toString());
+  }
+
+  // Add receive/parse/dispatch timestamps to a reply (probe mode only)
+  void annotate(cmdlib::Command& reply) const {
+    if (enabled) addTimestamps(reply);
+  }
+
+  // UART arrival of the command being handled, for PING clock sync
+  uint32_t receivedAt() const {
+    return rxUs;
+  }
+};
+
+extern LatencyProbe Probe;
+
+#endif // LATENCY_PROBE_H
@@ -0,0 +1,55 @@
+#include "SessionCapture.h"
+
+SessionCaptureStream SessionCapture;
+
+void SessionCaptureStream::dump(Print& out) {
+  bool wasEnabled = enabled;
+  enabled = false;
+
+  out.println("# session-capture v3");
+
+  size_t pos = tail;
+  size_t remaining = used;
+  uint32_t records = 0;
+  while (remaining >= HEADER_SIZE) {
+    char kind = (char)at(pos);
+    uint8_t len = at(pos + 1);
+    uint32_t t = at32(pos + 2);
+
+    out.print(kind);
+    out.print(' ');
+    out.print(t);
+    out.print(' ');
+    if (kind == SESSION_CAPTURE_RX) {
+      out.print(at32(pos + HEADER_SIZE));
+      out.print(' ');
+      // Inbound bytes are hex encoded: they may contain CR/LF or garbage
+      for (uint8_t i = RX_PREFIX; i < len; ++i) {
+        uint8_t b = at(pos + HEADER_SIZE + i);
+        if (b < 0x10) out.print('0');
+        out.print(b, HEX);
+      }
+    } else if (kind == SESSION_CAPTURE_SHOW) {
+      // count, then span, gap min/max and duration min/max/sum in us
+      out.print((uint16_t)(at(pos + HEADER_SIZE) | at(pos + HEADER_SIZE + 1) << 8));
+      for (size_t i = 2; i < SHOW_PAYLOAD; i += 4) {
+        out.print(' ');
+        out.print(at32(pos + HEADER_SIZE + i));
+      }
+    } else {
+      for (uint8_t i = 0; i < len; ++i) out.write(at(pos + HEADER_SIZE + i));
+    }
+    out.println();
+
+    pos += HEADER_SIZE + len;
+    remaining -= HEADER_SIZE + len;
+    records++;
+  }
+
+  out.print("# end records=");
+  out.print(records);
+  out.print(" dropped=");
+  out.println(droppedRecords);
+
+  enabled = wasEnabled;
+}
@@ -0,0 +1,310 @@
+// SessionCapture.h
+#ifndef SESSION_CAPTURE_H
+#define SESSION_CAPTURE_H
+
+#include <Arduino.h>
+
+// Size of the RAM ring that holds captured records (oldest records are dropped
+// when it is full). Override in platformio.ini build_flags if needed.
+#ifndef SESSION_CAPTURE_BUFFER_SIZE
+#define SESSION_CAPTURE_BUFFER_SIZE 16384
+#endif
+
+// Consecutive inbound bytes read within this window are stored in one record
+#ifndef SESSION_CAPTURE_COALESCE_US
+#define SESSION_CAPTURE_COALESCE_US 1000
+#endif
+
+// Arrival stamps from markArrival() not yet matched to a read byte. When
+// the queue is full, later bytes fall back to their read time.
+#ifndef SESSION_CAPTURE_MAX_ARRIVALS
+#define SESSION_CAPTURE_MAX_ARRIVALS 32
+#endif
+
+#define SESSION_CAPTURE_MAX_PAYLOAD 255
+
+// Record kinds, also used as the first column of the dump format
+#define SESSION_CAPTURE_RX 'R'    // inbound bytes: arrival time (4 bytes LE) + data
+#define SESSION_CAPTURE_TX 'T'    // one outbound line (without CR/LF)
+#define SESSION_CAPTURE_SHOW 'S'  // a run of FastLED.show() calls, payload = run summary
+
+// Stream decorator that records everything passing through the command link.
+// Inbound bytes carry both the time they reached the UART (markArrival()) and
+// the time the firmware read them, outbound data is split into lines, and
+// render frames are added with markShow(). Shows in a row are summarised in
+// one record, so an animation costs a few dozen bytes rather than one record
+// per frame.
+class SessionCaptureStream : public Stream {
+private:
+  struct Arrival {
+    uint32_t us;
+    uint32_t total;  // bytes received up to and including this burst
+  };
+
+  // Shows since the last other record; stored as one S record
+  struct ShowRun {
+    uint32_t firstUs;
+    uint32_t lastUs;
+    uint16_t count;
+    uint32_t gapMin;  // between show starts, 0 until the second show
+    uint32_t gapMax;
+    uint32_t durMin;
+    uint32_t durMax;
+    uint32_t durSum;
+  };
+
+  Stream* port;
+  bool enabled;
+
+  // Written by markArrival() in the UART task, read by read() in the loop task
+  volatile Arrival arrivals[SESSION_CAPTURE_MAX_ARRIVALS];
+  volatile uint8_t arrivalHead;
+  volatile uint8_t arrivalTail;
+  volatile uint32_t readCount;
+  uint32_t readArrivalUs;  // arrival time of the byte read last
+
+  uint8_t ring[SESSION_CAPTURE_BUFFER_SIZE];
+  size_t head;            // next write position
+  size_t tail;            // start of the oldest record
+  size_t used;
+  size_t openRx;          // start of the RX record still accepting bytes
+  bool rxOpen;
+  uint32_t lastRxUs;
+  uint32_t rxArrivalUs;   // arrival time shared by the bytes of the open RX record
+  size_t openShow;        // start of the S record still accepting shows
+  bool showOpen;
+  ShowRun run;
+  uint32_t droppedRecords;
+
+  char txLine[SESSION_CAPTURE_MAX_PAYLOAD];
+  uint8_t txLen;
+  uint32_t txStartUs;
+
+  static const size_t HEADER_SIZE = 6;  // kind, len, timestamp (4 bytes LE)
+  static const size_t RX_PREFIX = 4;    // arrival time at the start of an RX payload
+  static const size_t SHOW_PAYLOAD = 26; // count (2), span, gap min/max, duration min/max/sum
+
+  uint8_t at(size_t pos) const { return ring[pos % SESSION_CAPTURE_BUFFER_SIZE]; }
+  void put(size_t pos, uint8_t b) { ring[pos % SESSION_CAPTURE_BUFFER_SIZE] = b; }
+
+  uint32_t at32(size_t pos) const {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= (uint32_t)at(pos + i) << (8 * i);
+    return v;
+  }
+
+  static void encode32(uint8_t* out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out[i] = (v >> (8 * i)) & 0xFF;
+  }
+
+  void encodeRun(uint8_t* out) const {
+    out[0] = run.count & 0xFF;
+    out[1] = run.count >> 8;
+    encode32(out + 2, run.lastUs - run.firstUs);
+    encode32(out + 6, run.gapMin);
+    encode32(out + 10, run.gapMax);
+    encode32(out + 14, run.durMin);
+    encode32(out + 18, run.durMax);
+    encode32(out + 22, run.durSum);
+  }
+
+  void dropOldest() {
+    if (rxOpen && openRx == tail) rxOpen = false;
+    if (showOpen && openShow == tail) showOpen = false;
+    size_t len = HEADER_SIZE + at(tail + 1);
+    tail = (tail + len) % SESSION_CAPTURE_BUFFER_SIZE;
+    used -= len;
+    droppedRecords++;
+  }
+
+  void reserve(size_t bytes) {
+    while (used > 0 && SESSION_CAPTURE_BUFFER_SIZE - used < bytes) dropOldest();
+  }
+
+  void appendRecord(char kind, uint32_t t, const uint8_t* data, uint8_t len) {
+    rxOpen = false;  // only the newest record can grow
+    showOpen = false;
+    reserve(HEADER_SIZE + len);
+    put(head, kind);
+    put(head + 1, len);
+    for (int i = 0; i < 4; ++i) put(head + 2 + i, (t >> (8 * i)) & 0xFF);
+    for (uint8_t i = 0; i < len; ++i) put(head + HEADER_SIZE + i, data[i]);
+    head = (head + HEADER_SIZE + len) % SESSION_CAPTURE_BUFFER_SIZE;
+    used += HEADER_SIZE + len;
+  }
+
+  // Arrival time of inbound byte number index: the first burst stamped by
+  // markArrival() that contains it, or now when the loop read it first
+  uint32_t arrivalOf(uint32_t index, uint32_t now) {
+    while (arrivalTail != arrivalHead) {
+      const volatile Arrival& a = arrivals[arrivalTail];
+      if ((int32_t)(a.total - index) > 0) return a.us;
+      arrivalTail = (arrivalTail + 1) % SESSION_CAPTURE_MAX_ARRIVALS;
+    }
+    return now;
+  }
+
+  void recordRx(uint8_t b, uint32_t now, uint32_t arrival) {
+    bool append = rxOpen && arrival == rxArrivalUs && at(openRx + 1) < SESSION_CAPTURE_MAX_PAYLOAD &&
+                  now - lastRxUs <= SESSION_CAPTURE_COALESCE_US;
+    if (append) {
+      reserve(1);
+      append = rxOpen;  // reserve() may have dropped the open record
+    }
+    if (append) {
+      uint8_t len = at(openRx + 1);
+      put(openRx + HEADER_SIZE + len, b);
+      put(openRx + 1, len + 1);
+      head = (head + 1) % SESSION_CAPTURE_BUFFER_SIZE;
+      used++;
+    } else {
+      uint8_t payload[RX_PREFIX + 1];
+      for (int i = 0; i < 4; ++i) payload[i] = (arrival >> (8 * i)) & 0xFF;
+      payload[RX_PREFIX] = b;
+      reserve(HEADER_SIZE + sizeof(payload));
+      openRx = head;
+      appendRecord(SESSION_CAPTURE_RX, now, payload, sizeof(payload));
+      rxOpen = true;
+      rxArrivalUs = arrival;
+    }
+    lastRxUs = now;
+  }
+
+  void recordTx(uint8_t b) {
+    if (b == '\r') return;
+    if (b == '\n') {
+      if (txLen > 0) appendRecord(SESSION_CAPTURE_TX, txStartUs, (const uint8_t*)txLine, txLen);
+      txLen = 0;
+      return;
+    }
+    if (txLen == 0) txStartUs = micros();
+    if (txLen < SESSION_CAPTURE_MAX_PAYLOAD) txLine[txLen++] = (char)b;
+  }
+
+public:
+  SessionCaptureStream()
+    : port(nullptr), enabled(true), arrivalHead(0), arrivalTail(0), readCount(0),
+      readArrivalUs(0), run() {
+    clear();
+  }
+
+  // Attach the underlying serial port used for the command link
+  void begin(Stream* serial) {
+    port = serial;
+  }
+
+  // Enable or pause recording (data still passes through while paused)
+  void setEnabled(bool on) {
+    enabled = on;
+    rxOpen = false;
+    showOpen = false;
+  }
+
+  bool isEnabled() const {
+    return enabled;
+  }
+
+  // Discard all captured records
+  void clear() {
+    head = tail = used = 0;
+    openRx = 0;
+    rxOpen = false;
+    showOpen = false;
+    lastRxUs = 0;
+    rxArrivalUs = 0;
+    droppedRecords = 0;
+    txLen = 0;
+    txStartUs = 0;
+  }
+
+  // Stamp the bytes waiting in the UART as arrived now. Call it from the
+  // HardwareSerial::onReceive() callback, which runs when a burst ends (or
+  // the RX FIFO fills), so bytes that wait out a blocking animation keep
+  // their real arrival time. Safe to call from the UART task.
+  void markArrival() {
+    if (!port) return;
+    uint32_t now = micros();
+    uint32_t total = readCount + port->available();
+    uint8_t next = (arrivalHead + 1) % SESSION_CAPTURE_MAX_ARRIVALS;
+    if (next == arrivalTail) return;
+    arrivals[arrivalHead].us = now;
+    arrivals[arrivalHead].total = total;
+    arrivalHead = next;
+  }
+
+  // Record one render frame; call right after FastLED.show(). It joins the
+  // newest S record when nothing else was recorded since the previous show.
+  void markShow(uint32_t startUs, uint32_t durationUs) {
+    if (!enabled) return;
+    uint8_t payload[SHOW_PAYLOAD];
+    if (showOpen && run.count < 0xFFFF && run.durSum + durationUs >= run.durSum) {
+      uint32_t gap = startUs - run.lastUs;
+      if (run.count == 1 || gap < run.gapMin) run.gapMin = gap;
+      if (gap > run.gapMax) run.gapMax = gap;
+      if (durationUs < run.durMin) run.durMin = durationUs;
+      if (durationUs > run.durMax) run.durMax = durationUs;
+      run.durSum += durationUs;
+      run.lastUs = startUs;
+      run.count++;
+      encodeRun(payload);
+      for (size_t i = 0; i < SHOW_PAYLOAD; ++i) put(openShow + HEADER_SIZE + i, payload[i]);
+      return;
+    }
+    run = {startUs, startUs, 1, 0, 0, durationUs, durationUs, durationUs};
+    encodeRun(payload);
+    reserve(HEADER_SIZE + SHOW_PAYLOAD);
+    openShow = head;
+    appendRecord(SESSION_CAPTURE_SHOW, startUs, payload, SHOW_PAYLOAD);
+    showOpen = true;
+  }
+
+  // Write all captured records as text lines (see README for the format).
+  // Recording is paused while dumping so the dump does not capture itself.
+  void dump(Print& out);
+
+  // ---- Stream interface ----
+  int available() override {
+    return port ? port->available() : 0;
+  }
+
+  int read() override {
+    if (!port) return -1;
+    int c = port->read();
+    if (c < 0) return c;
+    // Arrival is tracked while recording is paused too, for LatencyProbe
+    uint32_t now = micros();
+    readArrivalUs = arrivalOf(readCount++, now);
+    if (enabled) recordRx((uint8_t)c, now, readArrivalUs);
+    return c;
+  }
+
+  // When the byte returned by the last read() reached the UART: the
+  // markArrival() stamp that covered it, or its read time without one
+  uint32_t arrivedAt() const {
+    return readArrivalUs;
+  }
+
+  int peek() override {
+    return port ? port->peek() : -1;
+  }
+
+  void flush() {
+    if (port) port->flush();
+  }
+
+  size_t write(uint8_t b) override {
+    if (enabled) recordTx(b);
+    return port ? port->write(b) : 0;
+  }
+
+  size_t write(const uint8_t* buffer, size_t size) override {
+    if (enabled) {
+      for (size_t i = 0; i < size; ++i) recordTx(buffer[i]);
+    }
+    return port ? port->write(buffer, size) : 0;
+  }
+};
+
+extern SessionCaptureStream SessionCapture;
+
+#endif // SESSION_CAPTURE_H
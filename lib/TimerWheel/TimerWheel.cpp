@@ -0,0 +1,164 @@
+#include "TimerWheel.h"
+
+TimerWheel Timers;
+
+#define L1_OFFSET TIMER_WHEEL_L0_SIZE
+#define L2_OFFSET (TIMER_WHEEL_L0_SIZE + TIMER_WHEEL_LN_SIZE)
+#define L1_SHIFT TIMER_WHEEL_L0_BITS
+#define L2_SHIFT (TIMER_WHEEL_L0_BITS + TIMER_WHEEL_LN_BITS)
+#define LN_MASK (TIMER_WHEEL_LN_SIZE - 1)
+#define WHEEL_SPAN (1UL << (L2_SHIFT + TIMER_WHEEL_LN_BITS))
+
+TimerWheel::TimerWheel() : current(0), started(false) {
+  for (int i = 0; i < TIMER_WHEEL_SLOTS; ++i) slots[i] = -1;
+  for (int i = 0; i < TIMER_WHEEL_MAX_TIMERS; ++i) {
+    timers[i].allocated = false;
+    timers[i].firing = false;
+    timers[i].slot = -1;
+  }
+}
+
+void TimerWheel::link(TimerId id) {
+  Timer& t = timers[id];
+  uint32_t delta = t.expires - current;
+  int16_t slot;
+
+  if ((int32_t)delta < 0) {
+    // Already due: fire on the next processed tick
+    slot = current & (TIMER_WHEEL_L0_SIZE - 1);
+  } else if (delta < TIMER_WHEEL_L0_SIZE) {
+    slot = t.expires & (TIMER_WHEEL_L0_SIZE - 1);
+  } else if (delta < (1UL << L2_SHIFT)) {
+    slot = L1_OFFSET + ((t.expires >> L1_SHIFT) & LN_MASK);
+  } else {
+    uint32_t target = (delta < WHEEL_SPAN) ? t.expires : current + WHEEL_SPAN - 1;
+    slot = L2_OFFSET + ((target >> L2_SHIFT) & LN_MASK);
+  }
+
+  t.slot = slot;
+  t.prev = -1;
+  t.next = slots[slot];
+  if (t.next >= 0) timers[t.next].prev = id;
+  slots[slot] = id;
+}
+
+void TimerWheel::unlink(TimerId id) {
+  Timer& t = timers[id];
+  t.firing = false;  // stopped or re-armed before its callback ran
+  if (t.slot < 0) return;
+  if (t.prev >= 0) timers[t.prev].next = t.next;
+  else slots[t.slot] = t.next;
+  if (t.next >= 0) timers[t.next].prev = t.prev;
+  t.slot = -1;
+}
+
+void TimerWheel::cascade(int16_t slot) {
+  TimerId id = slots[slot];
+  slots[slot] = -1;
+  while (id >= 0) {
+    TimerId next = timers[id].next;
+    timers[id].slot = -1;
+    link(id);
+    id = next;
+  }
+}
+
+void TimerWheel::expire(TimerId id, uint32_t now) {
+  Timer& t = timers[id];
+  if (t.periodic) {
+    t.expires += t.interval;
+    // Skip missed periods instead of firing a burst after a long stall
+    if ((int32_t)(t.expires - now) <= 0) t.expires = now + t.interval;
+    link(id);
+  }
+  if (t.callback) t.callback(t.ctx);
+}
+
+TimerId TimerWheel::allocate(uint32_t delayMs, uint32_t periodMs, bool periodic, TimerCallback cb, void* ctx) {
+  for (TimerId id = 0; id < TIMER_WHEEL_MAX_TIMERS; ++id) {
+    if (timers[id].allocated) continue;
+    Timer& t = timers[id];
+    t.allocated = true;
+    t.callback = cb;
+    t.ctx = ctx;
+    t.periodic = periodic;
+    t.firing = false;
+    t.interval = periodic ? periodMs : delayMs;
+    t.slot = -1;
+    restart(id);
+    return id;
+  }
+  return TIMER_INVALID;
+}
+
+bool TimerWheel::restart(TimerId id) {
+  if (!valid(id)) return false;
+  uint32_t now = millis();
+  if (!started) {
+    current = now;
+    started = true;
+  }
+  unlink(id);
+  timers[id].expires = now + timers[id].interval;
+  link(id);
+  return true;
+}
+
+bool TimerWheel::stop(TimerId id) {
+  if (!valid(id)) return false;
+  unlink(id);
+  return true;
+}
+
+void TimerWheel::cancel(TimerId id) {
+  if (!valid(id)) return;
+  unlink(id);
+  timers[id].allocated = false;
+}
+
+void TimerWheel::update(uint32_t now) {
+  if (!started) {
+    current = now;
+    started = true;
+  }
+
+  while ((int32_t)(now - current) >= 0) {
+    uint32_t index = current & (TIMER_WHEEL_L0_SIZE - 1);
+    if (index == 0) {
+      uint32_t l1 = (current >> L1_SHIFT) & LN_MASK;
+      if (l1 == 0) cascade(L2_OFFSET + ((current >> L2_SHIFT) & LN_MASK));
+      cascade(L1_OFFSET + l1);
+    }
+
+    // Detach the whole slot first: callbacks may add, restart or cancel
+    // timers, including ones that are due on this same tick
+    TimerId due[TIMER_WHEEL_MAX_TIMERS];
+    int count = 0;
+    for (TimerId id = slots[index]; id >= 0; id = timers[id].next) {
+      due[count++] = id;
+      timers[id].slot = -1;
+      timers[id].firing = true;
+    }
+    slots[index] = -1;
+    current++;
+
+    for (int i = 0; i < count; ++i) {
+      if (!timers[due[i]].firing) continue;
+      timers[due[i]].firing = false;
+      expire(due[i], now);
+    }
+  }
+}
+
+uint32_t TimerWheel::nextDeadline(uint32_t now) const {
+  // The pool is small, so a linear scan is cheaper than walking empty slots
+  uint32_t best = TIMER_NO_DEADLINE;
+  for (TimerId id = 0; id < TIMER_WHEEL_MAX_TIMERS; ++id) {
+    const Timer& t = timers[id];
+    if (!t.allocated || t.slot < 0) continue;
+    int32_t left = (int32_t)(t.expires - now);
+    if (left <= 0) return 0;
+    if ((uint32_t)left < best) best = left;
+  }
+  return best;
+}
@@ -0,0 +1,104 @@
+// TimerWheel.h
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <Arduino.h>
+
+// Size of the static timer pool (no dynamic allocation)
+#ifndef TIMER_WHEEL_MAX_TIMERS
+#define TIMER_WHEEL_MAX_TIMERS 16
+#endif
+
+// Wheel geometry: 1 ms ticks, 256 slots on the first level and 64 on the two
+// upper levels, which covers 256 * 64 * 64 ms (~17.9 minutes) directly.
+// Longer timers park in the last slot and are re-filed when they cascade.
+#define TIMER_WHEEL_L0_BITS 8
+#define TIMER_WHEEL_LN_BITS 6
+#define TIMER_WHEEL_L0_SIZE (1 << TIMER_WHEEL_L0_BITS)
+#define TIMER_WHEEL_LN_SIZE (1 << TIMER_WHEEL_LN_BITS)
+#define TIMER_WHEEL_SLOTS (TIMER_WHEEL_L0_SIZE + 2 * TIMER_WHEEL_LN_SIZE)
+
+#define TIMER_INVALID -1
+#define TIMER_NO_DEADLINE 0xFFFFFFFFUL
+
+typedef int16_t TimerId;
+typedef void (*TimerCallback)(void* ctx);
+
+class TimerWheel {
+private:
+  struct Timer {
+    uint32_t expires;     // absolute tick (millis)
+    uint32_t interval;    // delay used by restart(), period when periodic
+    TimerCallback callback;
+    void* ctx;
+    int16_t next;
+    int16_t prev;
+    int16_t slot;         // -1 when not on the wheel
+    bool periodic;
+    bool allocated;
+    bool firing;          // detached from a due slot, callback not run yet
+  };
+
+  Timer timers[TIMER_WHEEL_MAX_TIMERS];
+  int16_t slots[TIMER_WHEEL_SLOTS];  // list heads, -1 when empty
+  uint32_t current;                  // next tick to be processed
+  bool started;
+
+  void link(TimerId id);
+  void unlink(TimerId id);
+  void cascade(int16_t slot);
+  void expire(TimerId id, uint32_t now);
+
+  bool valid(TimerId id) const {
+    return id >= 0 && id < TIMER_WHEEL_MAX_TIMERS && timers[id].allocated;
+  }
+
+  TimerId allocate(uint32_t delayMs, uint32_t periodMs, bool periodic, TimerCallback cb, void* ctx);
+
+  // Timers are armed against millis(), so the wheel is only ever advanced
+  // and queried on that same clock
+  void update(uint32_t now);
+  uint32_t nextDeadline(uint32_t now) const;
+
+public:
+  TimerWheel();
+
+  // Run callback once after delayMs. Returns TIMER_INVALID when the pool is full.
+  TimerId once(uint32_t delayMs, TimerCallback cb, void* ctx = nullptr) {
+    return allocate(delayMs, delayMs, false, cb, ctx);
+  }
+
+  // Run callback every periodMs, first time after periodMs
+  TimerId every(uint32_t periodMs, TimerCallback cb, void* ctx = nullptr) {
+    return allocate(periodMs, periodMs, true, cb, ctx);
+  }
+
+  // Re-arm a timer with its original delay, counted from now. One-shot timers
+  // stay allocated after they fire, so they can be restarted (e.g. liveness).
+  bool restart(TimerId id);
+
+  // Stop a timer without releasing it
+  bool stop(TimerId id);
+
+  // Stop and release a timer
+  void cancel(TimerId id);
+
+  bool isActive(TimerId id) const {
+    return valid(id) && timers[id].slot >= 0;
+  }
+
+  // Fire every timer that is due. Call this regularly from loop().
+  void update() {
+    update(millis());
+  }
+
+  // Milliseconds until the next timer fires (0 when one is already due),
+  // or TIMER_NO_DEADLINE when no timer is armed.
+  uint32_t nextDeadline() const {
+    return nextDeadline(millis());
+  }
+};
+
+extern TimerWheel Timers;
+
+#endif // TIMER_WHEEL_H
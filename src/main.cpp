@@ -1,8 +1,14 @@
 #include <Arduino.h>
 #include <FastLED.h>
 
+#include "ArmLayout.h"
+#include "ArmState.h"
 #include "CmdLib.h"
+#include "FrameStream.h"
+#include "LatencyProbe.h"
 #include "PingPong.h"
+#include "SessionCapture.h"
+#include "TimerWheel.h"
 
 // =============================================================
 // FUNCTIES
@@ -13,6 +19,15 @@ CRGB parseColor(String c, int val);
 void readSerial(void);
 void parseCommand(String line);
 void handleIdleAnimation(void);
+void showLeds(void);
+void sweepStar(const CRGB& color, int size, int delayPerStep);
+void animationDelay(uint32_t ms);
+void waitForNextEvent(void);
+void onIdleTick(void* ctx);
+void onSerialReceive(void);
+void restoreState(const ArmSettings& saved);
+void persistState(void);
+void announceReady(bool restored);
 
 // =============================================================
 // PIN CONFIGURATIE & LED-STRIPS
@@ -27,11 +42,28 @@ void handleIdleAnimation(void);
 #define NUM_BOTTOM_ARM 150
 #define NUM_MIC_STAR 200
 
+// The three arm strips run side by side from the base, so every effect is
+// written against arm position 0..Arm::length-1
+typedef ArmLayout<
+    StripLayout<PIN_SIDE_ARM, NUM_SIDE_ARM, BRG>,
+    StripLayout<PIN_TOP_ARM, NUM_TOP_ARM, BRG>,
+    StripLayout<PIN_BOTTOM_ARM, NUM_BOTTOM_ARM, BRG>>
+    Arm;
+
 CRGB sideArm[NUM_SIDE_ARM];
 CRGB topArm[NUM_TOP_ARM];
 CRGB bottomArm[NUM_BOTTOM_ARM];
 CRGB micStar[NUM_MIC_STAR];
 
+CRGB* const armStrips[] = {sideArm, topArm, bottomArm};  // same order as Arm
+
+// Back buffers for FRAME streaming: packets decode here while the strips
+// above keep showing the previous frame
+CRGB sideArmBack[NUM_SIDE_ARM];
+CRGB topArmBack[NUM_TOP_ARM];
+CRGB bottomArmBack[NUM_BOTTOM_ARM];
+CRGB micStarBack[NUM_MIC_STAR];
+
 uint8_t STAR_R = 255;
 uint8_t STAR_G = 191;
 uint8_t STAR_B = 3;
@@ -43,6 +75,7 @@ CRGB idleColor = CRGB(STAR_R, STAR_G, STAR_B);
 
 #define IDLE_ANIMATION_INTERVAL 10000  // 10 seconds for testing, can be adjusted
 #define PING_PONG_TIMEOUT_MS 45000
+#define LOOP_MAX_SLEEP_MS 100  // upper bound on one loop sleep, even without timers
 // =============================================================
 // VARIABELEN
 // =============================================================
@@ -56,58 +89,95 @@ String serialLine;
 
 bool starIsMade = false;
 
-unsigned long lastIdleAnimationTimestamp = 0;
+bool idleAnimationDue = false;
+
+TaskHandle_t loopTaskHandle = nullptr;  // woken by onSerialReceive()
 
 HardwareSerial* MySerial = &Serial2;  // Change to prefered Serial port
+Stream* CmdSerial = &SessionCapture;  // MySerial, recorded for DUMP_CAPTURE
+
+#define DEBUG_BAUD 115200  // USB serial, used for capture dumps
 
 // =============================================================
 // SETUP
 // =============================================================
 void setup() {
-    // MySerial->begin(9600, SERIAL_8N1, RX_PIN, TX_PIN);
-    MySerial->begin(9600);
-
-    delay(1000);
-
-    FastLED.addLeds<WS2811, PIN_SIDE_ARM, BRG>(sideArm, NUM_SIDE_ARM);
-    FastLED.addLeds<WS2811, PIN_TOP_ARM, BRG>(topArm, NUM_TOP_ARM);
-    FastLED.addLeds<WS2811, PIN_BOTTOM_ARM, BRG>(bottomArm, NUM_BOTTOM_ARM);
+    // LEDs first, so strips that powered up showing noise are blanked quickly
+    Arm::addLeds<WS2811>(armStrips);
     FastLED.addLeds<WS2811, PIN_MIC_STAR, BRG>(micStar, NUM_MIC_STAR);
+    FastLED.clear(true);
 
-    FastLED.clear();
-    FastLED.show();
-
-    PingPong.init(PING_PONG_TIMEOUT_MS, MySerial);
-    MySerial->println("ESP Ready: ARM + MIC STAR (FastLED + CmdLib active)");
+    // MySerial->begin(9600, SERIAL_8N1, RX_PIN, TX_PIN);
+    MySerial->begin(9600);
+    SessionCapture.begin(MySerial);
+    loopTaskHandle = xTaskGetCurrentTaskHandle();
+    MySerial->onReceive(onSerialReceive);
+    Serial.begin(DEBUG_BAUD);
+
+    // Last configuration and star state from before the power cycle
+    ArmSettings saved;
+    bool restored = ArmState.begin(saved);
+    if (restored) restoreState(saved);
+    if (starIsMade) fill_solid(micStar, NUM_MIC_STAR, CRGB(micBrightness, micBrightness, 0));
+    showLeds();
+
+    FrameStream.attach("side", sideArm, sideArmBack, NUM_SIDE_ARM);
+    FrameStream.attach("top", topArm, topArmBack, NUM_TOP_ARM);
+    FrameStream.attach("bottom", bottomArm, bottomArmBack, NUM_BOTTOM_ARM);
+    FrameStream.attach("mic", micStar, micStarBack, NUM_MIC_STAR);
+
+    PingPong.init(PING_PONG_TIMEOUT_MS, CmdSerial);
+    Probe.init(CmdSerial);
+    Timers.every(IDLE_ANIMATION_INTERVAL, onIdleTick);
+    announceReady(restored);
 }
 
 // =============================================================
 // MAIN LOOP
 // =============================================================
 void loop() {
-    PingPong.update();  // handle PING/PONG idle detection
+    Timers.update();  // PING/PONG liveness, idle animation tick
     readSerial();
 
-    if (PING_IDLE) {  // optional reaction if idle
+    if (idleAnimationDue) {  // set by onIdleTick() while PING_IDLE
+        idleAnimationDue = false;
         cmdlib::Command errResp;
         errResp.addHeader("MASTER");
         errResp.msgKind = "ERROR";
         errResp.command = "PING_IDLE";
-        MySerial->println(errResp.toString());
+        CmdSerial->println(errResp.toString());
         handleIdleAnimation();
     }
+
+    ArmState.update();  // debounced NVS write, if one is due
+    waitForNextEvent();
+}
+
+// Sleep until the next timer is due or serial data arrives
+void waitForNextEvent() {
+    if (CmdSerial->available() || idleAnimationDue) return;
+    uint32_t wait = Timers.nextDeadline();
+    if (wait > LOOP_MAX_SLEEP_MS) wait = LOOP_MAX_SLEEP_MS;
+    if (wait > 0) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+}
+
+// Runs in the UART task when a burst of bytes has arrived
+void onSerialReceive() {
+    SessionCapture.markArrival();
+    if (loopTaskHandle) xTaskNotifyGive(loopTaskHandle);
 }
 
 // =============================================================
 // SERIAL PARSER
 // =============================================================
 void readSerial() {
-    while (MySerial->available()) {
-        char c = MySerial->read();
+    while (CmdSerial->available()) {
+        char c = CmdSerial->read();
+        if (serialLine.length() == 0) Probe.markLineStart(SessionCapture.arrivedAt());
         serialLine += c;
         if (serialLine.endsWith("##")) {
             parseCommand(serialLine);
-            // MySerial->println(serialLine);  // echo naar hoofdserial
+            // CmdSerial->println(serialLine);  // echo naar hoofdserial
             serialLine = "";
         }
     }
@@ -123,11 +193,13 @@ void parseCommand(String line) {
         errResp.msgKind = "ERROR";
         errResp.command = parsedCmd.command;
         errResp.setNamed("message", err);
-        MySerial->println(errResp.toString());
+        CmdSerial->println(errResp.toString());
         return;
     }
+    Probe.markParsed();
+
     if (parsedCmd.command == "PING") {
-        PingPong.processCommand(parsedCmd);
+        PingPong.processCommand(parsedCmd, Probe.receivedAt());
         return;
     }
 
@@ -137,7 +209,31 @@ void parseCommand(String line) {
         errResp.msgKind = "ERROR";
         errResp.command = parsedCmd.command;
         errResp.setNamed("message", "Invalid message kind");
-        MySerial->println(errResp.toString());
+        CmdSerial->println(errResp.toString());
+        return;
+    }
+
+    Probe.markDispatch(parsedCmd);
+
+    // Streamed frames are the hot path: no CONFIRM per packet, only errors
+    if (parsedCmd.command == "FRAME") {
+        String frameErr;
+        FrameResult result = FrameStream.processCommand(parsedCmd, frameErr);
+        if (result == FRAME_READY) {
+            // Per-packet probes only when the sender asks for one, and only
+            // for the packet that shows the frame
+            if (parsedCmd.getNamed("pid").length() > 0) Probe.expectShow();
+            showLeds();
+        } else if (result == FRAME_ERROR) {
+            cmdlib::Command errResp;
+            errResp.addHeader("MASTER");
+            errResp.msgKind = "ERROR";
+            errResp.command = parsedCmd.command;
+            errResp.setNamed("message", frameErr);
+            errResp.setNamed("q", parsedCmd.getNamed("q"));
+            errResp.setNamed("s", parsedCmd.getNamed("s"));
+            CmdSerial->println(errResp.toString());
+        }
         return;
     }
 
@@ -145,118 +241,117 @@ void parseCommand(String line) {
      * Should sending a star away reset the starIsMade flag?
      */
     if (parsedCmd.command == "MAKE_STAR") {
-        starIsMade = true;
-        micBrightness = parsedCmd.getNamed("brightness", "50").toInt();
-        if (micBrightness < 0 || micBrightness > 255) {
+        // Validate before touching the state, so a rejected value is never persisted
+        int brightness = parsedCmd.getNamed("brightness", "50").toInt();
+        if (brightness < 0 || brightness > 255) {
             cmdlib::Command errResp;
             errResp.addHeader("MASTER");
             errResp.msgKind = "ERROR";
             errResp.command = parsedCmd.command;
-            errResp.setNamed("message", "BRIGHTNESS_OUT_OF_RANGE (0-255), received=" + micBrightness);
-            MySerial->println(errResp.toString());
+            errResp.setNamed("message", "BRIGHTNESS_OUT_OF_RANGE (0-255), received=" + String(brightness));
+            CmdSerial->println(errResp.toString());
             return;
         }
+        FrameStream.invalidate();
+        starIsMade = true;
         sendConfirm("MAKE_STAR");
-        micBrightness = constrain(micBrightness, 0, 255);
+        Probe.expectShow();
+        micBrightness = brightness;
         fill_solid(micStar, NUM_MIC_STAR, CRGB(micBrightness, micBrightness, 0));
-        FastLED.show();
+        showLeds();
+        persistState();
     } else if (parsedCmd.command == "UPDATE_STAR") {
         if (starIsMade == true) {
-            micBrightness = parsedCmd.getNamed("brightness", String(micBrightness)).toInt();
-            if (micBrightness < 0 || micBrightness > 255) {
+            int brightness = parsedCmd.getNamed("brightness", String(micBrightness)).toInt();
+            if (brightness < 0 || brightness > 255) {
                 cmdlib::Command errResp;
                 errResp.addHeader("MASTER");
                 errResp.msgKind = "ERROR";
                 errResp.command = parsedCmd.command;
-                errResp.setNamed("message", "BRIGHTNESS_OUT_OF_RANGE (0-255), received=" + micBrightness);
-                MySerial->println(errResp.toString());
+                errResp.setNamed("message", "BRIGHTNESS_OUT_OF_RANGE (0-255), received=" + String(brightness));
+                CmdSerial->println(errResp.toString());
                 return;
             }
+            FrameStream.invalidate();
             sendConfirm("UPDATE_STAR");
-            micBrightness = constrain(micBrightness, 0, 255);
+            Probe.expectShow();
+            micBrightness = brightness;
             fill_solid(micStar, NUM_MIC_STAR, CRGB(micBrightness, micBrightness, 0));
-            FastLED.show();
-
+            showLeds();
+            persistState();
         } else {
             cmdlib::Command errResp;
             errResp.addHeader("MASTER");
             errResp.msgKind = "ERROR";
             errResp.command = parsedCmd.command;
             errResp.setNamed("message", "STAR_NOT_MADE_YET");
-            MySerial->println(errResp.toString());
+            CmdSerial->println(errResp.toString());
             return;
         }
     } else if (parsedCmd.command == "SEND_STAR") {
-        starIsMade = false;
         // Direct confirm sturen
         sendConfirm("SEND_STAR");
 
-        sendBrightness = parsedCmd.getNamed("brightness", String(sendBrightness)).toInt();
-        sendBrightness = constrain(sendBrightness, 0, 255);
-        sendSize = parsedCmd.getNamed("size", String(sendSize)).toInt();
-        sendSpeed = parsedCmd.getNamed("speed", String(sendSpeed)).toInt();
-
-        if (sendSpeed < 1 || sendSpeed > 10) {
+        int speed = parsedCmd.getNamed("speed", String(sendSpeed)).toInt();
+        if (speed < 1 || speed > 10) {
             cmdlib::Command errResp;
             errResp.addHeader("MASTER");
             errResp.msgKind = "ERROR";
             errResp.command = parsedCmd.command;
-            errResp.setNamed("message", "SPEED_OUT_OF_RANGE (1-10), received=" + sendSpeed);
-            MySerial->println(errResp.toString());
+            errResp.setNamed("message", "SPEED_OUT_OF_RANGE (1-10), received=" + String(speed));
+            CmdSerial->println(errResp.toString());
             return;
         }
+        FrameStream.invalidate();
+        starIsMade = false;
+        sendSpeed = speed;
+        sendBrightness = parsedCmd.getNamed("brightness", String(sendBrightness)).toInt();
+        sendBrightness = constrain(sendBrightness, 0, 255);
+        sendSize = parsedCmd.getNamed("size", String(sendSize)).toInt();
+        sendSize = constrain(sendSize, 0, (int)Arm::length);
 
+        Probe.expectShow();
         String colorStr = parsedCmd.getNamed("color", "yellow");
         sendColor = parseColor(colorStr, sendBrightness);
 
         // Mic dimmen
         for (int b = micBrightness; b >= 0; b--) {
             fill_solid(micStar, NUM_MIC_STAR, CRGB(b, b, 0));
-            FastLED.show();
-            delay(5);
+            showLeds();
+            animationDelay(5);
         }
         micBrightness = 0;
+        persistState();
 
-        // ARM strips volledig dimmen
-        nscale8_video(sideArm, NUM_SIDE_ARM, 0);
-        nscale8_video(topArm, NUM_TOP_ARM, 0);
-        nscale8_video(bottomArm, NUM_BOTTOM_ARM, 0);
-        FastLED.show();
-        delay(20);
-
-        // Send star animatie
-        int delayPerStep = map(sendSpeed, 1, 10, 40, 5);
-        for (int i = NUM_SIDE_ARM - 1; i >= -sendSize; i--) {
-            fill_solid(sideArm, NUM_SIDE_ARM, CRGB::Black);
-            fill_solid(topArm, NUM_TOP_ARM, CRGB::Black);
-            fill_solid(bottomArm, NUM_BOTTOM_ARM, CRGB::Black);
-
-            for (int j = 0; j < sendSize; j++) {
-                int pos = i + j;
-                if (pos >= 0 && pos < NUM_SIDE_ARM) sideArm[pos] = sendColor;
-                if (pos >= 0 && pos < NUM_TOP_ARM) topArm[pos] = sendColor;
-                if (pos >= 0 && pos < NUM_BOTTOM_ARM) bottomArm[pos] = sendColor;
-            }
-
-            FastLED.show();
-            delay(delayPerStep);
-            yield();
-        }
-
-        // ARM strips resetten
-        fill_solid(sideArm, NUM_SIDE_ARM, CRGB::Black);
-        fill_solid(topArm, NUM_TOP_ARM, CRGB::Black);
-        fill_solid(bottomArm, NUM_BOTTOM_ARM, CRGB::Black);
-        FastLED.show();
+        sweepStar(sendColor, sendSize, map(sendSpeed, 1, 10, 40, 5));
 
         sendRequest("STAR_ARRIVED");
+    } else if (parsedCmd.command == "FRAME_STATS") {
+        cmdlib::Command stats;
+        stats.addHeader("MASTER");
+        stats.msgKind = "CONFIRM";
+        stats.command = "FRAME_STATS";
+        stats.setNamed("frames", String(FrameStream.frames()));
+        stats.setNamed("fps", String(FrameStream.fps(), 1));
+        stats.setNamed("ratio", String(FrameStream.compressionRatio(), 2));
+        stats.setNamed("dropped", String(FrameStream.dropped()));
+        stats.setNamed("errors", String(FrameStream.errors()));
+        CmdSerial->println(stats.toString());
+    } else if (parsedCmd.command == "PROBE") {
+        Probe.setEnabled(parsedCmd.getNamed("enabled", "1").toInt() == 1);
+        sendConfirm("PROBE");
+    } else if (parsedCmd.command == "DUMP_CAPTURE") {
+        // Capture goes out over USB so the command link stays clean
+        sendConfirm("DUMP_CAPTURE");
+        SessionCapture.dump(Serial);
+        if (parsedCmd.getNamed("clear", "0").toInt() == 1) SessionCapture.clear();
     } else {
         cmdlib::Command errResp;
         errResp.addHeader("MASTER");
         errResp.msgKind = "ERROR";
         errResp.command = parsedCmd.command;
         errResp.setNamed("message", "Unknown command: " + parsedCmd.command);
-        MySerial->println(errResp.toString());
+        CmdSerial->println(errResp.toString());
     }
 }
 
@@ -264,60 +359,54 @@ void parseCommand(String line) {
 // IDLE ANIMATIE
 // =============================================================
 
-void handleIdleAnimation() {
-    unsigned long now = millis();
-    if (now - lastIdleAnimationTimestamp > IDLE_ANIMATION_INTERVAL) {
-        starIsMade = false;
-        FastLED.show();
-
-        int randomStarBrightness = random(50, 256);
-        for (int b = 0; b < randomStarBrightness; b += 1) {
-            fill_solid(micStar, NUM_MIC_STAR, CRGB(b, b, 0));
-            FastLED.show();
-            delay(17);
-        }
+// Periodic timer: only flags the animation, loop() runs it
+void onIdleTick(void* ctx) {
+    if (PING_IDLE) idleAnimationDue = true;
+}
 
-        for (int b = randomStarBrightness; b >= 0; b -= 1) {
-            fill_solid(micStar, NUM_MIC_STAR, CRGB(b, b, 0));
-            FastLED.show();
-            delay(17);
-        }
-        fill_solid(micStar, NUM_MIC_STAR, CRGB(0, 0, 0));
-
-        // ARM strips volledig dimmen
-        nscale8_video(sideArm, NUM_SIDE_ARM, 0);
-        nscale8_video(topArm, NUM_TOP_ARM, 0);
-        nscale8_video(bottomArm, NUM_BOTTOM_ARM, 0);
-        FastLED.show();
-        delay(20);
-
-        // Send star animatie
-        int delayPerStep = map(sendSpeed, 1, 10, 40, 5);
-        for (int i = NUM_SIDE_ARM - 1; i >= -sendSize; i--) {
-            fill_solid(sideArm, NUM_SIDE_ARM, CRGB::Black);
-            fill_solid(topArm, NUM_TOP_ARM, CRGB::Black);
-            fill_solid(bottomArm, NUM_BOTTOM_ARM, CRGB::Black);
-
-            for (int j = 0; j < sendSize; j++) {
-                int pos = i + j;
-                if (pos >= 0 && pos < NUM_SIDE_ARM) sideArm[pos] = idleColor;
-                if (pos >= 0 && pos < NUM_TOP_ARM) topArm[pos] = idleColor;
-                if (pos >= 0 && pos < NUM_BOTTOM_ARM) bottomArm[pos] = idleColor;
-            }
+void handleIdleAnimation() {
+    FrameStream.invalidate();
+    starIsMade = false;
+    persistState();
+    showLeds();
+
+    int randomStarBrightness = random(50, 256);
+    for (int b = 0; b < randomStarBrightness; b += 1) {
+        fill_solid(micStar, NUM_MIC_STAR, CRGB(b, b, 0));
+        showLeds();
+        animationDelay(17);
+    }
 
-            FastLED.show();
-            delay(delayPerStep);
-            yield();
-        }
+    for (int b = randomStarBrightness; b >= 0; b -= 1) {
+        fill_solid(micStar, NUM_MIC_STAR, CRGB(b, b, 0));
+        showLeds();
+        animationDelay(17);
+    }
+    fill_solid(micStar, NUM_MIC_STAR, CRGB(0, 0, 0));
 
-        // ARM strips resetten
-        fill_solid(sideArm, NUM_SIDE_ARM, CRGB::Black);
-        fill_solid(topArm, NUM_TOP_ARM, CRGB::Black);
-        fill_solid(bottomArm, NUM_BOTTOM_ARM, CRGB::Black);
-        FastLED.show();
+    sweepStar(idleColor, sendSize, map(sendSpeed, 1, 10, 40, 5));
+}
 
-        lastIdleAnimationTimestamp = now;
+// Star travelling from the tip of the arm to the base, on all arm strips
+void sweepStar(const CRGB& color, int size, int delayPerStep) {
+    // ARM strips volledig dimmen
+    Arm::scale(armStrips, 0);
+    showLeds();
+    animationDelay(20);
+
+    // Only the pixel leaving the tail changes besides the star itself
+    for (int i = Arm::length - 1; i >= -size; i--) {
+        Arm::fill(armStrips, i + size, 1, CRGB::Black);
+        Arm::fill(armStrips, i, size, color);
+
+        showLeds();
+        animationDelay(delayPerStep);
+        yield();
     }
+
+    // ARM strips resetten
+    Arm::clear(armStrips);
+    showLeds();
 }
 
 // =============================================================
@@ -327,14 +416,65 @@ void sendConfirm(const char* cmdName) {
     cmdlib::Command confirm;
     confirm.msgKind = "MASTER:CONFIRM";
     confirm.command = String(cmdName);
-    MySerial->println(confirm.toString());
+    Probe.annotate(confirm);
+    CmdSerial->println(confirm.toString());
 }
 
 void sendRequest(const char* cmdName) {
     cmdlib::Command request;
     request.msgKind = "MASTER:REQUEST";
     request.command = String(cmdName);
-    MySerial->println(request.toString());
+    CmdSerial->println(request.toString());
+}
+
+// Saved values are clamped like the commands do: a bad value in NVS must not
+// survive every reboot (sendSpeed outside 1-10 breaks the sweep timing)
+void restoreState(const ArmSettings& saved) {
+    micBrightness = constrain(saved.micBrightness, 0, 255);
+    sendBrightness = constrain(saved.sendBrightness, 0, 255);
+    sendSpeed = constrain(saved.sendSpeed, 1, 10);
+    sendSize = constrain(saved.sendSize, 0, (int)Arm::length);
+    sendColor = CRGB(saved.sendR, saved.sendG, saved.sendB);
+    starIsMade = saved.starIsMade;
+}
+
+// Hand the current state to ArmState; it is written once it stops changing
+void persistState() {
+    ArmSettings state;
+    state.version = ARM_STATE_VERSION;
+    state.micBrightness = micBrightness;
+    state.sendBrightness = sendBrightness;
+    state.sendSpeed = sendSpeed;
+    state.sendR = sendColor.r;
+    state.sendG = sendColor.g;
+    state.sendB = sendColor.b;
+    state.starIsMade = starIsMade;
+    state.sendSize = sendSize;
+    ArmState.save(state);
+}
+
+// Replaces the old plain-text banner; t_us is the time from boot to ready
+void announceReady(bool restored) {
+    cmdlib::Command ready;
+    ready.addHeader("MASTER");
+    ready.msgKind = "REQUEST";
+    ready.command = "READY";
+    ready.setNamed("t_us", String(micros()));
+    ready.setNamed("restored", restored ? "1" : "0");
+    CmdSerial->println(ready.toString());
+}
+
+// delay() for animation steps that keeps the timer wheel running
+void animationDelay(uint32_t ms) {
+    delay(ms);
+    Timers.update();
+}
+
+void showLeds() {
+    uint32_t start = micros();
+    FastLED.show();
+    SessionCapture.markShow(start, micros() - start);
+    Probe.markShown();
 }
 
 // =============================================================
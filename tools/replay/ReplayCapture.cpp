@@ -0,0 +1,526 @@
+// ReplayCapture.cpp
+// Host-side replay of a session capture (see lib/SessionCapture/README.md).
+//
+// The arm firmware (src/main.cpp and lib/) is linked into this tool against
+// the stand-ins in host/: a virtual clock behind millis()/micros()/delay(),
+// a UART that receives the captured inbound bytes at their recorded arrival
+// time, and a FastLED.show() that only notes when it ran. setup() and loop()
+// then run unchanged, so readSerial(), parseCommand() and every handler see
+// the same traffic as on the night, including bytes that pile up in the UART
+// during a blocking animation.
+//
+// The replies the firmware writes are paired with the requests on the wire,
+// which gives per-command response latency, requests that never got an
+// answer, and render (FastLED.show) timing. The same analysis runs on the
+// replies in the capture itself, as the reference.
+//
+// Build: make
+// Run:   ./replay-capture [--tail-ms N] capture.txt
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CmdLib.h"
+
+// Firmware entry points and command port (src/main.cpp)
+void setup();
+void loop();
+extern HardwareSerial* MySerial;
+
+namespace {
+
+// Virtual time kept running after the last captured byte, so replies to it
+// and the animations it started are still seen
+const uint64_t kDefaultTailUs = 2000000;
+
+// S record: FastLED.show() calls in a row, times in us
+struct ShowRun {
+  uint32_t count;
+  uint32_t span;  // first to last show start
+  uint32_t gapMin, gapMax;
+  uint32_t durMin, durMax, durSum;
+};
+
+struct Record {
+  char kind;
+  uint64_t t;        // microseconds, unwrapped to 64 bit
+  uint64_t arrival;  // R: when the bytes reached the UART
+  std::string data;  // decoded RX bytes or TX line
+  ShowRun run;       // S: starting at t
+};
+
+// Device timestamps are 32-bit micros(), which wrap every ~71 minutes
+class VirtualClock {
+ public:
+  uint64_t unwrap(uint32_t raw) {
+    if (started_ && raw < last_ && last_ - raw > 0x80000000UL) epoch_ += (1ULL << 32);
+    started_ = true;
+    last_ = raw;
+    return epoch_ + raw;
+  }
+
+ private:
+  bool started_ = false;
+  uint32_t last_ = 0;
+  uint64_t epoch_ = 0;
+};
+
+struct Stats {
+  std::vector<double> samples;
+
+  void add(double v) { samples.push_back(v); }
+
+  void print(const char* unit) const {
+    if (samples.empty()) {
+      std::printf("n=0\n");
+      return;
+    }
+    std::vector<double> s = samples;
+    std::sort(s.begin(), s.end());
+    double sum = 0;
+    for (double v : s) sum += v;
+    size_t p95 = std::min(s.size() - 1, (size_t)(s.size() * 0.95));
+    std::printf("n=%zu min=%.2f avg=%.2f p95=%.2f max=%.2f %s\n", s.size(), s.front(),
+                sum / s.size(), s[p95], s.back(), unit);
+  }
+};
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool decodeHex(const std::string& hex, std::string& out) {
+  if (hex.empty() || hex.size() % 2) return false;
+  out.clear();
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    int hi = hexValue(hex[i]);
+    int lo = hexValue(hex[i + 1]);
+    if (hi < 0 || lo < 0) return false;
+    out.push_back((char)(hi << 4 | lo));
+  }
+  return true;
+}
+
+// Decimal 32-bit value, digits only
+bool parseUnsigned(const std::string& text, uint32_t& out) {
+  if (text.empty() || text.size() > 10) return false;
+  uint64_t v = 0;
+  for (char c : text) {
+    if (c < '0' || c > '9') return false;
+    v = v * 10 + (c - '0');
+  }
+  if (v > 0xFFFFFFFFULL) return false;
+  out = (uint32_t)v;
+  return true;
+}
+
+// Totals of a show run must lie between n times its minimum and maximum
+bool plausible(const ShowRun& run) {
+  if (run.count == 0) return false;
+  uint64_t gaps = run.count - 1;
+  return (uint64_t)run.gapMin * gaps <= run.span && run.span <= (uint64_t)run.gapMax * gaps &&
+         (uint64_t)run.durMin * run.count <= run.durSum &&
+         run.durSum <= (uint64_t)run.durMax * run.count;
+}
+
+// Requests the firmware answers only when they fail (streamed frames)
+bool repliesOnlyOnError(const std::string& command) { return command == "FRAME"; }
+
+// Lines the arm sends on its own, not in reply to a request
+bool isNotice(const cmdlib::Command& line, const std::string& kind, const std::string& command) {
+  if (kind == "REQUEST") return command == "READY" || command == "STAR_ARRIVED";
+  // LatencyProbe report, sent after the show; the PROBE toggle's own CONFIRM has no t_show
+  if (kind == "CONFIRM" && command == "PROBE") return line.getNamed("t_show").length() > 0;
+  return kind == "ERROR" && command == "PING_IDLE";
+}
+
+// FRAME packets are told apart by frame number and strip
+std::string frameKey(const cmdlib::Command& cmd) {
+  return std::string(cmd.getNamed("q").c_str()) + "/" + cmd.getNamed("s").c_str();
+}
+
+bool loadCapture(std::istream& in, std::vector<Record>& records, std::string& error) {
+  VirtualClock clock;
+  std::string line;
+  size_t lineNo = 0;
+  while (std::getline(in, line)) {
+    lineNo++;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty() || line[0] == '#') continue;
+
+    std::istringstream ss(line);
+    std::string kind, stamp;
+    uint32_t raw = 0;
+    if (!(ss >> kind >> stamp) || kind.size() != 1 || !parseUnsigned(stamp, raw)) {
+      error = "Malformed record on line " + std::to_string(lineNo);
+      return false;
+    }
+    std::string rest;
+    std::getline(ss, rest);
+    if (!rest.empty() && rest[0] == ' ') rest.erase(0, 1);
+
+    Record r{kind[0], clock.unwrap(raw), 0, "", {}};
+    r.arrival = r.t;
+    if (r.kind == 'R') {
+      // v2: "<arrival> <hex>", v1: "<hex>" (arrival unknown, use the read time)
+      std::istringstream fields(rest);
+      std::string first, second, extra;
+      fields >> first >> second >> extra;
+      std::string hex = first;
+      if (!second.empty()) {
+        uint32_t arrivalRaw = 0;
+        if (!parseUnsigned(first, arrivalRaw) || !extra.empty()) {
+          error = "Bad arrival time on line " + std::to_string(lineNo);
+          return false;
+        }
+        uint32_t waited = raw - arrivalRaw;
+        if (waited < 0x80000000UL) r.arrival = r.t - waited;
+        hex = second;
+      }
+      if (!decodeHex(hex, r.data)) {
+        error = "Bad hex payload on line " + std::to_string(lineNo);
+        return false;
+      }
+    } else if (r.kind == 'T') {
+      r.data = rest;
+    } else if (r.kind == 'S') {
+      // v3: "<count> <span> <gap min> <gap max> <dur min> <dur max> <dur sum>",
+      // v2: "<duration>" for a single show
+      std::istringstream fields(rest);
+      std::vector<uint32_t> v;
+      std::string field;
+      while (fields >> field) {
+        uint32_t n = 0;
+        if (!parseUnsigned(field, n)) break;
+        v.push_back(n);
+      }
+      ShowRun& run = r.run;
+      if (v.size() == 1 && fields.eof()) {
+        run = {1, 0, 0, 0, v[0], v[0], v[0]};
+      } else if (v.size() == 7 && fields.eof()) {
+        run = {v[0], v[1], v[2], v[3], v[4], v[5], v[6]};
+      }
+      if (!plausible(run)) {
+        error = "Bad show record on line " + std::to_string(lineNo);
+        return false;
+      }
+    } else {
+      error = "Unknown record kind on line " + std::to_string(lineNo);
+      return false;
+    }
+    records.push_back(r);
+  }
+  return true;
+}
+
+// Pairs the requests on the wire with the arm's replies
+class Session {
+ public:
+  // One inbound byte that reached the arm's UART at t
+  void received(uint64_t t, char c) { events_.push_back({t, kIn, std::string(1, c)}); }
+
+  // One outbound line written at t
+  void sent(uint64_t t, const std::string& line) { events_.push_back({t, kOut, line}); }
+
+  // One FastLED.show() at t
+  void shown(uint64_t t) { events_.push_back({t, kShow, ""}); }
+
+  // A recorded run of shows starting at t
+  void shown(uint64_t t, const ShowRun& run);
+
+  void analyze();
+  void print() const;
+
+  // Requests that should have been answered but were not
+  size_t unanswered() const;
+
+ private:
+  enum EventKind { kIn, kOut, kShow };
+
+  // Marks the last show of a recorded run
+  static constexpr const char* kRunEnd = "run-end";
+
+  struct Event {
+    uint64_t t;
+    EventKind kind;
+    std::string data;
+  };
+
+  struct Pending {
+    std::string command;
+    std::string key;    // FRAME: frame number and strip
+    uint64_t complete;  // arrival of the last byte
+    bool silent;        // no reply unless it fails
+  };
+
+  std::vector<Event> events_;
+  std::map<std::string, Stats> latency_;  // per command, ms
+  std::map<std::string, int> errors_;     // ERROR replies per command
+  std::vector<Pending> pending_;
+  std::map<std::string, int> silent_;   // requests per command answered only on error
+  std::map<std::string, int> notices_;  // lines the arm sent on its own
+  Stats showInterval_, showDuration_;
+  int malformed_ = 0;
+  int unsolicited_ = 0;
+  size_t unterminated_ = 0;
+
+  void request(uint64_t t, const std::string& line);
+  void reply(uint64_t t, const std::string& line);
+};
+
+void Session::shown(uint64_t t, const ShowRun& run) {
+  events_.push_back({t, kShow, ""});
+  showDuration_.add(run.durMin / 1000.0);
+  if (run.count == 1) return;
+  events_.push_back({t + run.span, kShow, kRunEnd});
+  showDuration_.add(run.durMax / 1000.0);
+  showInterval_.add(run.gapMin / 1000.0);
+  if (run.count > 2) showInterval_.add(run.gapMax / 1000.0);
+
+  // Only the extremes and the totals are recorded; the frames in between
+  // count at the run's remaining average, so min/avg/max stay exact
+  if (run.count > 2) {
+    double restDur = (run.durSum - run.durMin - run.durMax) / 1000.0 / (run.count - 2);
+    for (uint32_t i = 2; i < run.count; ++i) showDuration_.add(restDur);
+  }
+  if (run.count > 3) {
+    double restGap = (run.span - run.gapMin - run.gapMax) / 1000.0 / (run.count - 3);
+    for (uint32_t i = 3; i < run.count; ++i) showInterval_.add(restGap);
+  }
+}
+
+void Session::analyze() {
+  // Inbound bytes before outbound lines at the same instant: a reply can not
+  // precede its request
+  std::stable_sort(events_.begin(), events_.end(), [](const Event& a, const Event& b) {
+    return a.t != b.t ? a.t < b.t : a.kind < b.kind;
+  });
+
+  // Mirror of readSerial(): accumulate until the line ends with "##"
+  std::string serialLine;
+  uint64_t lastShow = 0;
+  bool haveShow = false;
+  for (const Event& e : events_) {
+    if (e.kind == kIn) {
+      serialLine += e.data;
+      if (serialLine.size() >= 2 && serialLine.compare(serialLine.size() - 2, 2, "##") == 0) {
+        request(e.t, serialLine);
+        serialLine.clear();
+      }
+    } else if (e.kind == kOut) {
+      reply(e.t, e.data);
+    } else {
+      // Intervals inside a recorded run were added with the run
+      if (haveShow && e.data != kRunEnd) showInterval_.add((e.t - lastShow) / 1000.0);
+      lastShow = e.t;
+      haveShow = true;
+    }
+  }
+  unterminated_ = serialLine.size();
+}
+
+void Session::request(uint64_t t, const std::string& line) {
+  cmdlib::Command cmd;
+  String err;
+  if (!cmdlib::parse(String(line), cmd, err)) {
+    malformed_++;
+    // The firmware still answers with an ERROR that has no command name
+    pending_.push_back({"", "", t, false});
+    return;
+  }
+  std::string command = cmd.command.c_str();
+  bool silent = repliesOnlyOnError(command);
+  if (silent) silent_[command]++;
+  pending_.push_back({command, silent ? frameKey(cmd) : "", t, silent});
+}
+
+void Session::reply(uint64_t t, const std::string& line) {
+  cmdlib::Command reply;
+  String err;
+  if (!cmdlib::parse(String(line), reply, err)) return;
+  std::string kind = reply.msgKind.c_str();
+  std::string command = reply.command.c_str();
+  if (kind != "ERROR" && command == "ERROR") {
+    // Parse errors are answered as !!MASTER:ERROR{...}## without a command
+    kind = "ERROR";
+    command.clear();
+  }
+  if (isNotice(reply, kind, command)) {
+    notices_[command]++;
+    return;
+  }
+  if (kind != "CONFIRM" && kind != "ERROR") return;
+
+  auto it = std::find_if(pending_.begin(), pending_.end(),
+                         [&](const Pending& p) { return p.command == command; });
+  if (it != pending_.end() && it->silent && reply.getNamed("q").length() > 0) {
+    // A rejected FRAME packet: with retransmits several share the frame
+    // number and strip, and the rejected one is the newest of them
+    std::string key = frameKey(reply);
+    auto last = pending_.end();
+    for (auto p = pending_.begin(); p != pending_.end() && p->complete <= t; ++p) {
+      if (p->command == command && p->key == key) last = p;
+    }
+    it = last;
+  }
+  if (it == pending_.end()) {
+    unsolicited_++;
+    return;
+  }
+  std::string name = it->command.empty() ? "<malformed>" : it->command;
+  latency_[name].add((t - it->complete) / 1000.0);
+  if (kind == "ERROR") errors_[name]++;
+  uint64_t handled = it->complete;
+  pending_.erase(it);
+
+  // Requests are handled in order, so silent requests that came in before
+  // this one went through without an error
+  pending_.erase(std::remove_if(pending_.begin(), pending_.end(),
+                                [&](const Pending& p) { return p.silent && p.complete < handled; }),
+                 pending_.end());
+}
+
+size_t Session::unanswered() const {
+  return std::count_if(pending_.begin(), pending_.end(), [](const Pending& p) { return !p.silent; });
+}
+
+void Session::print() const {
+  std::printf("response latency (last byte in -> reply):\n");
+  for (const auto& kv : latency_) {
+    std::printf("  %-14s ", kv.first.c_str());
+    kv.second.print("ms");
+    auto e = errors_.find(kv.first);
+    if (e != errors_.end()) std::printf("  %-14s errors=%d\n", "", e->second);
+  }
+
+  for (const auto& kv : silent_) {
+    std::printf("  %-14s %d sent, no reply unless rejected\n", kv.first.c_str(), kv.second);
+  }
+
+  std::printf("dropped frames (no reply): %zu\n", unanswered());
+  for (const Pending& p : pending_) {
+    if (p.silent) continue;
+    std::printf("  %-14s at %.3f ms\n", p.command.empty() ? "<malformed>" : p.command.c_str(),
+                p.complete / 1000.0);
+  }
+  std::printf("malformed frames: %d\n", malformed_);
+  std::printf("unsolicited replies: %d\n", unsolicited_);
+  if (!notices_.empty()) {
+    std::printf("arm notices:");
+    for (const auto& kv : notices_) std::printf(" %s=%d", kv.first.c_str(), kv.second);
+    std::printf("\n");
+  }
+  if (unterminated_) std::printf("unterminated bytes at end: %zu\n", unterminated_);
+
+  std::printf("render frames:\n  interval ");
+  showInterval_.print("ms");
+  if (!showDuration_.samples.empty()) {
+    std::printf("  show     ");
+    showDuration_.print("ms");
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t tailUs = kDefaultTailUs;
+  const char* path = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    uint32_t ms = 0;
+    if (arg == "--tail-ms" && i + 1 < argc && parseUnsigned(argv[i + 1], ms)) {
+      tailUs = (uint64_t)ms * 1000;
+      i++;
+    } else if (!path && arg[0] != '-') {
+      path = argv[i];
+    } else {
+      path = nullptr;
+      break;
+    }
+  }
+  if (!path) {
+    std::cerr << "usage: " << argv[0] << " [--tail-ms N] <capture.txt>\n";
+    return 2;
+  }
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "cannot open " << path << "\n";
+    return 2;
+  }
+
+  std::vector<Record> records;
+  std::string error;
+  if (!loadCapture(file, records, error)) {
+    std::cerr << error << "\n";
+    return 2;
+  }
+  if (records.empty()) {
+    std::cerr << "capture has no records\n";
+    return 2;
+  }
+
+  // Reference: the replies the arm actually sent on the night
+  Session recorded;
+  uint64_t start = UINT64_MAX, lastArrival = 0;
+  for (const Record& r : records) {
+    start = std::min(start, std::min(r.t, r.arrival));
+    if (r.kind == 'R') {
+      for (char c : r.data) recorded.received(r.arrival, c);
+      lastArrival = std::max(lastArrival, r.arrival);
+    } else if (r.kind == 'T') {
+      recorded.sent(r.t, r.data);
+    } else {
+      recorded.shown(r.t, r.run);
+    }
+  }
+  recorded.analyze();
+
+  // Replay: boot the firmware at the start of the capture and feed it the
+  // inbound bytes at their arrival time
+  Session replayed;
+  host::boot(start);
+  for (const Record& r : records) {
+    if (r.kind != 'R') continue;
+    MySerial->schedule(r.arrival, r.data);
+    for (char c : r.data) replayed.received(r.arrival, c);
+  }
+
+  setup();
+  uint64_t end = std::max(lastArrival, start) + tailUs;
+  while (host::now() < end) {
+    uint64_t before = host::now();
+    loop();
+    if (host::now() == before) host::advanceTo(before + 1);
+  }
+
+  for (const HardwareSerial::Line& l : MySerial->lines()) replayed.sent(l.us, l.text);
+  for (uint64_t t : FastLED.shows()) replayed.shown(t);
+  replayed.analyze();
+
+  std::printf("records: %zu\n", records.size());
+  std::printf("span: %.3f s\n", (records.back().t - records.front().t) / 1e6);
+  std::printf("replayed until: %.3f s after the first record\n", (host::now() - start) / 1e6);
+  std::printf("inbound bytes: %llu delivered, %llu lost to a full RX buffer\n",
+              (unsigned long long)MySerial->bytesDelivered(),
+              (unsigned long long)MySerial->bytesOverflowed());
+
+  std::printf("\n== replay (current firmware) ==\n");
+  replayed.print();
+  std::printf("\n== recorded ==\n");
+  recorded.print();
+
+  return replayed.unanswered() ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+// Arduino.h
+// Host stand-in for the ESP32 Arduino core, used to build the arm firmware
+// into the replay tool. Time is virtual: it only moves when the firmware
+// waits (delay(), ulTaskNotifyTake()) or when the replay driver advances it,
+// and inbound bytes are handed to HardwareSerial at their captured arrival time.
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+
+#define SERIAL_8N1 0x800001c
+
+// Default RX buffer of HardwareSerial in the ESP32 core; bytes arriving while
+// it is full are lost, like on the device
+#ifndef HOST_SERIAL_RX_BUFFER
+#define HOST_SERIAL_RX_BUFFER 256
+#endif
+
+// ---- Time ----
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+inline void yield() {}
+
+// ---- Math helpers ----
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// ---- FreeRTOS task notifications (single loop task) ----
+typedef void* TaskHandle_t;
+typedef uint32_t TickType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(int clearCountOnExit, TickType_t ticksToWait);
+
+// ---- Print / Stream ----
+class Print {
+ public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char* s) { return write((const uint8_t*)s, std::strlen(s)); }
+  virtual void flush() {}
+
+  size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(int v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(unsigned int v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(unsigned long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(double v, int decimals = 2) { return print(String(v, (unsigned char)decimals)); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& v) {
+    size_t n = print(v);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(const T& v, int format) {
+    size_t n = print(v, format);
+    return n + println();
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+// UART with a virtual wire: the replay driver schedules inbound bytes, and
+// every outbound line is kept with the virtual time it was written.
+class HardwareSerial : public Stream {
+ public:
+  struct Line {
+    uint64_t us;  // virtual time of the first byte
+    std::string text;
+  };
+
+  explicit HardwareSerial(int uart);
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {
+    baud_ = baud;
+  }
+  void end() {}
+  unsigned long baudRate() const { return baud_; }
+
+  void onReceive(std::function<void(void)> callback, bool onlyOnTimeout = false) {
+    onReceive_ = callback;
+  }
+
+  int available() override { return (int)rx_.size(); }
+  int read() override;
+  int peek() override { return rx_.empty() ? -1 : (uint8_t)rx_.front(); }
+
+  size_t write(uint8_t b) override;
+  using Print::write;
+
+  // ---- host side ----
+  // Queue bytes that reach the UART at virtual time us
+  void schedule(uint64_t us, const std::string& bytes) { wire_.push_back({us, bytes}); }
+  // Arrival time of the next scheduled burst, UINT64_MAX when none is left
+  uint64_t nextArrival() const { return wire_.empty() ? UINT64_MAX : wire_.front().us; }
+  // Move every burst due at or before us into the RX buffer
+  void deliver(uint64_t us);
+
+  const std::vector<Line>& lines() const { return lines_; }
+  uint64_t bytesDelivered() const { return delivered_; }
+  uint64_t bytesOverflowed() const { return overflowed_; }
+
+ private:
+  struct Burst {
+    uint64_t us;
+    std::string bytes;
+  };
+
+  unsigned long baud_ = 0;
+  std::function<void(void)> onReceive_;
+  std::deque<char> rx_;
+  std::deque<Burst> wire_;
+  std::vector<Line> lines_;
+  std::string txLine_;
+  uint64_t txLineUs_ = 0;
+  uint64_t delivered_ = 0;
+  uint64_t overflowed_ = 0;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial2;
+
+// ---- Replay driver interface ----
+namespace host {
+
+// Virtual time in microseconds, 64 bit (micros() is its low 32 bits)
+uint64_t now();
+
+// Set the virtual clock at boot, before setup()
+void boot(uint64_t us);
+
+// Move the virtual clock forward to us, delivering inbound bytes on the way
+void advanceTo(uint64_t us);
+
+// Earliest scheduled inbound byte on any port
+uint64_t nextArrival();
+
+}  // namespace host
+
+#endif  // HOST_ARDUINO_H
@@ -0,0 +1,77 @@
+// FastLED.h
+// Host stand-in for FastLED: pixel buffers and helpers behave as on the
+// device, show() writes nothing and only records when it was called.
+#ifndef HOST_FASTLED_H
+#define HOST_FASTLED_H
+
+#include <Arduino.h>
+
+enum EOrder { RGB = 0012, RBG = 0021, GRB = 0102, GBR = 0120, BRG = 0201, BGR = 0210 };
+
+struct CRGB {
+  uint8_t r, g, b;
+
+  enum HTMLColorCode { Black = 0x000000, White = 0xFFFFFF };
+
+  CRGB() : r(0), g(0), b(0) {}
+  constexpr CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+  constexpr CRGB(HTMLColorCode code)
+    : r((code >> 16) & 0xFF), g((code >> 8) & 0xFF), b(code & 0xFF) {}
+
+  bool operator==(const CRGB& o) const { return r == o.r && g == o.g && b == o.b; }
+  bool operator!=(const CRGB& o) const { return !(*this == o); }
+};
+
+inline void fill_solid(CRGB* leds, int count, const CRGB& color) {
+  for (int i = 0; i < count; ++i) leds[i] = color;
+}
+
+inline uint8_t scale8_video(uint8_t v, uint8_t scale) {
+  return (uint8_t)(((int)v * scale >> 8) + ((v && scale) ? 1 : 0));
+}
+
+inline void nscale8_video(CRGB* leds, uint16_t count, uint8_t scale) {
+  for (uint16_t i = 0; i < count; ++i) {
+    leds[i].r = scale8_video(leds[i].r, scale);
+    leds[i].g = scale8_video(leds[i].g, scale);
+    leds[i].b = scale8_video(leds[i].b, scale);
+  }
+}
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER = RGB>
+class WS2811 {};
+
+class CLEDController {};
+
+class CFastLED {
+ public:
+  template <template <uint8_t, EOrder> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+  CLEDController& addLeds(CRGB* data, int count, int offset = 0) {
+    strips_.push_back({data + offset, count});
+    return controller_;
+  }
+
+  void clear(bool writeData = false) {
+    for (const Strip& s : strips_) fill_solid(s.leds, s.count, CRGB::Black);
+    if (writeData) show();
+  }
+
+  void show() { shows_.push_back(host::now()); }
+
+  // ---- host side ----
+  const std::vector<uint64_t>& shows() const { return shows_; }
+
+ private:
+  struct Strip {
+    CRGB* leds;
+    int count;
+  };
+
+  CLEDController controller_;
+  std::vector<Strip> strips_;
+  std::vector<uint64_t> shows_;
+};
+
+extern CFastLED FastLED;
+
+#endif  // HOST_FASTLED_H
@@ -0,0 +1,131 @@
+// HostArduino.cpp
+// Virtual clock, UARTs and task notification behind host/Arduino.h.
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include <algorithm>
+
+namespace {
+
+uint64_t clockUs = 0;
+uint32_t notifyCount = 0;
+unsigned long randomState = 1;
+
+std::vector<HardwareSerial*>& ports() {
+  static std::vector<HardwareSerial*> all;
+  return all;
+}
+
+}  // namespace
+
+HardwareSerial Serial(0);
+HardwareSerial Serial2(2);
+CFastLED FastLED;
+
+// ---- Time ----
+
+uint32_t millis() { return (uint32_t)(clockUs / 1000); }
+
+uint32_t micros() { return (uint32_t)clockUs; }
+
+void delay(uint32_t ms) { host::advanceTo(clockUs + (uint64_t)ms * 1000); }
+
+namespace host {
+
+uint64_t now() { return clockUs; }
+
+void boot(uint64_t us) {
+  clockUs = us;
+  notifyCount = 0;
+}
+
+uint64_t nextArrival() {
+  uint64_t next = UINT64_MAX;
+  for (HardwareSerial* p : ports()) next = std::min(next, p->nextArrival());
+  return next;
+}
+
+void advanceTo(uint64_t us) {
+  // Deliver in arrival order so onReceive callbacks see the right time
+  for (uint64_t next = nextArrival(); next <= us; next = nextArrival()) {
+    if (next > clockUs) clockUs = next;
+    for (HardwareSerial* p : ports()) p->deliver(clockUs);
+  }
+  if (us > clockUs) clockUs = us;
+}
+
+}  // namespace host
+
+// ---- Math helpers ----
+
+void randomSeed(unsigned long seed) { randomState = seed ? seed : 1; }
+
+long random(long max) {
+  if (max <= 0) return 0;
+  // Fixed LCG so a replay is repeatable
+  randomState = randomState * 1103515245UL + 12345UL;
+  return (long)((randomState >> 16) % (unsigned long)max);
+}
+
+long random(long min, long max) {
+  if (min >= max) return min;
+  return min + random(max - min);
+}
+
+// ---- Task notifications ----
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return &notifyCount; }
+
+void xTaskNotifyGive(TaskHandle_t task) { notifyCount++; }
+
+uint32_t ulTaskNotifyTake(int clearCountOnExit, TickType_t ticksToWait) {
+  if (notifyCount == 0) {
+    // Sleep until the timeout or until the next byte arrives, whichever is first
+    uint64_t wake = clockUs + (uint64_t)ticksToWait * 1000;
+    host::advanceTo(std::min(wake, std::max(clockUs, host::nextArrival())));
+  }
+  uint32_t count = notifyCount;
+  if (count) notifyCount = clearCountOnExit ? 0 : count - 1;
+  return count;
+}
+
+// ---- HardwareSerial ----
+
+HardwareSerial::HardwareSerial(int uart) { ports().push_back(this); }
+
+int HardwareSerial::read() {
+  if (rx_.empty()) return -1;
+  uint8_t c = (uint8_t)rx_.front();
+  rx_.pop_front();
+  return c;
+}
+
+size_t HardwareSerial::write(uint8_t b) {
+  if (b == '\r') return 1;
+  if (b == '\n') {
+    if (!txLine_.empty()) lines_.push_back({txLineUs_, txLine_});
+    txLine_.clear();
+    return 1;
+  }
+  if (txLine_.empty()) txLineUs_ = clockUs;
+  txLine_ += (char)b;
+  return 1;
+}
+
+void HardwareSerial::deliver(uint64_t us) {
+  bool received = false;
+  while (!wire_.empty() && wire_.front().us <= us) {
+    for (char c : wire_.front().bytes) {
+      if (rx_.size() < HOST_SERIAL_RX_BUFFER) {
+        rx_.push_back(c);
+        delivered_++;
+      } else {
+        overflowed_++;
+      }
+    }
+    wire_.pop_front();
+    received = true;
+  }
+  if (received && onReceive_) onReceive_();
+}
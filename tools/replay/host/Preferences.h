@@ -0,0 +1,40 @@
+// Preferences.h
+// Host stand-in for the ESP32 NVS Preferences API. Starts empty (a fresh arm)
+// and keeps values in memory for the length of one replay.
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <Arduino.h>
+
+#include <map>
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false) {
+    ns_ = name;
+    return true;
+  }
+  void end() {}
+
+  size_t getBytes(const char* key, void* buf, size_t maxLen) {
+    auto it = store()[ns_].find(key);
+    if (it == store()[ns_].end() || it->second.size() > maxLen) return 0;
+    std::memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+
+  size_t putBytes(const char* key, const void* value, size_t len) {
+    store()[ns_][key].assign((const char*)value, len);
+    return len;
+  }
+
+ private:
+  std::string ns_;
+
+  static std::map<std::string, std::map<std::string, std::string>>& store() {
+    static std::map<std::string, std::map<std::string, std::string>> nvs;
+    return nvs;
+  }
+};
+
+#endif  // HOST_PREFERENCES_H
@@ -0,0 +1,106 @@
+// WString.h
+// Host stand-in for the Arduino String class, covering the subset the
+// firmware and its libraries use.
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+class String {
+ public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  explicit String(char c) : s_(1, c) {}
+  explicit String(unsigned char v, unsigned char base = 10) : s_(number(v, base)) {}
+  explicit String(int v, unsigned char base = 10) : s_(base == 10 ? std::to_string(v) : number((unsigned)v, base)) {}
+  explicit String(unsigned int v, unsigned char base = 10) : s_(number(v, base)) {}
+  explicit String(long v, unsigned char base = 10) : s_(base == 10 ? std::to_string(v) : number((unsigned long)v, base)) {}
+  explicit String(unsigned long v, unsigned char base = 10) : s_(number(v, base)) {}
+  explicit String(float v, unsigned char decimals = 2) : s_(fixed(v, decimals)) {}
+  explicit String(double v, unsigned char decimals = 2) : s_(fixed(v, decimals)) {}
+
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  const char* c_str() const { return s_.c_str(); }
+  const std::string& str() const { return s_; }
+
+  char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+
+  bool startsWith(const String& p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String& p) const {
+    return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+
+  int indexOf(char c, unsigned int from = 0) const { return pos(s_.find(c, from)); }
+  int indexOf(const String& p, unsigned int from = 0) const { return pos(s_.find(p.s_, from)); }
+  int lastIndexOf(char c) const { return pos(s_.rfind(c)); }
+  int lastIndexOf(const String& p) const { return pos(s_.rfind(p.s_)); }
+
+  String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= s_.size()) return String();
+    if (to > s_.size()) to = (unsigned int)s_.size();
+    return String(s_.substr(from, to - from));
+  }
+
+  long toInt() const { return std::strtol(s_.c_str(), nullptr, 10); }
+  float toFloat() const { return std::strtof(s_.c_str(), nullptr); }
+
+  void toLowerCase() {
+    for (char& c : s_) c = (char)std::tolower((unsigned char)c);
+  }
+  void toUpperCase() {
+    for (char& c : s_) c = (char)std::toupper((unsigned char)c);
+  }
+
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator==(const char* o) const { return s_ == (o ? o : ""); }
+  bool operator!=(const char* o) const { return !(*this == o); }
+
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* o) { s_ += o ? o : ""; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  String& operator+=(int v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(unsigned int v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(long v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(unsigned long v) { s_ += std::to_string(v); return *this; }
+
+ private:
+  std::string s_;
+
+  static int pos(std::string::size_type p) { return p == std::string::npos ? -1 : (int)p; }
+
+  static std::string number(unsigned long v, unsigned char base) {
+    if (base < 2 || base > 36) base = 10;
+    std::string out;
+    do {
+      int d = v % base;
+      out.insert(out.begin(), (char)(d < 10 ? '0' + d : 'A' + d - 10));
+      v /= base;
+    } while (v);
+    return out;
+  }
+
+  static std::string fixed(double v, unsigned char decimals) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    return buf;
+  }
+};
+
+inline String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, char b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, int b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, unsigned int b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, long b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, unsigned long b) { String r(a); r += b; return r; }
+
+#endif  // HOST_WSTRING_H